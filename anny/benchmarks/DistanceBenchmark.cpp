@@ -0,0 +1,112 @@
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include "core/matrix.h"
+#include "core/distance.h"
+#include "benchmark_utils.h"
+
+using namespace anny;
+
+/*
+	Per-call overhead of distance dispatch: std::function returned by distance_func_factory (indirect call per pair)
+	vs. static dispatch through visit_distance (metric is chosen once, the loop is instantiated for the concrete functor)
+	vs. distance_batch over a list of row indices (register-blocked kernels, prefetch of the next rows),
+	for contiguous rows and for 64-byte aligned rows padded to the cache line (MatrixStorageAligned).
+*/
+
+constexpr size_t NUM_ROWS = 4096;
+constexpr size_t NUM_PASSES = 200;
+
+Matrix<float> make_random_matrix(size_t rows, size_t cols)
+{
+	std::default_random_engine gen;
+	std::uniform_real_distribution<float> dis{ -1.0f, 1.0f };
+	Matrix<float> m(rows, cols);
+	for (size_t i = 0; i < rows; i++)
+		for (size_t j = 0; j < cols; j++)
+			m(i, j) = dis(gen);
+	return m;
+}
+
+double bench_std_function(Matrix<float>& data, DistanceId id)
+{
+	DistanceFunc<float> dist = distance_func_factory<float>(id);
+	auto q = data[0];
+	float sum = 0;
+	bench::Timer timer;
+	for (size_t pass = 0; pass < NUM_PASSES; pass++)
+		for (size_t i = 0; i < data.num_rows(); i++)
+			sum += dist(data[i], q);
+	double elapsed = timer.elapsed_seconds();
+	bench::do_not_optimize(sum);
+	return elapsed * 1e9 / (NUM_PASSES * data.num_rows());
+}
+
+double bench_static_dispatch(Matrix<float>& data, DistanceId id)
+{
+	return visit_distance<float>(id, [&data](auto dist) {
+		auto q = data[0];
+		float sum = 0;
+		bench::Timer timer;
+		for (size_t pass = 0; pass < NUM_PASSES; pass++)
+			for (size_t i = 0; i < data.num_rows(); i++)
+				sum += dist(data[i], q);
+		double elapsed = timer.elapsed_seconds();
+		bench::do_not_optimize(sum);
+		return elapsed * 1e9 / (NUM_PASSES * data.num_rows());
+	});
+}
+
+template <typename Storage>
+double bench_distance_batch(Matrix<float, Storage>& data, DistanceId id)
+{
+	return visit_distance<float>(id, [&data](auto dist) {
+		std::vector<size_t> indices(data.num_rows());
+		std::iota(indices.begin(), indices.end(), 0);
+		std::vector<float> out;
+		auto q = data[0];
+		float sum = 0;
+		bench::Timer timer;
+		for (size_t pass = 0; pass < NUM_PASSES; pass++)
+		{
+			distance_batch<decltype(dist)>(q, data, indices, out);
+			sum += out.back();
+		}
+		double elapsed = timer.elapsed_seconds();
+		bench::do_not_optimize(sum);
+		return elapsed * 1e9 / (NUM_PASSES * data.num_rows());
+	});
+}
+
+int main()
+{
+	const std::pair<DistanceId, std::string> metrics[] = {
+		{ DistanceId::L2, "L2" },
+		{ DistanceId::L2_SQUARED, "L2_SQUARED" },
+		{ DistanceId::COSINE, "COSINE" },
+		{ DistanceId::MANHATTAN, "MANHATTAN" }
+	};
+
+	for (size_t dim : { 4, 16, 128, 960 })
+	{
+		auto data = make_random_matrix(NUM_ROWS, dim);
+		MatrixStorageAligned<float> aligned_storage(NUM_ROWS, dim);
+		for (size_t i = 0; i < NUM_ROWS; i++)
+			std::copy(data[i].begin(), data[i].end(), aligned_storage[i].begin());
+		Matrix<float, MatrixStorageAligned<float>> aligned(std::move(aligned_storage));
+		std::cout << "dim = " << dim << std::endl;
+		for (const auto& [id, name] : metrics)
+		{
+			double ns_func = bench_std_function(data, id);
+			double ns_static = bench_static_dispatch(data, id);
+			double ns_batch = bench_distance_batch(data, id);
+			double ns_aligned = bench_distance_batch(aligned, id);
+			bench::print_row("  " + name + " std::function", ns_func, "ns/call");
+			bench::print_row("  " + name + " static dispatch", ns_static, "ns/call");
+			bench::print_row("  " + name + " distance_batch", ns_batch, "ns/call");
+			bench::print_row("  " + name + " distance_batch, aligned rows", ns_aligned, "ns/call");
+		}
+	}
+	return 0;
+}
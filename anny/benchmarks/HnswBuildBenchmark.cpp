@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "algs/hnsw.h"
+#include "algs/vanilla_knn.h"
+#include "utils/dataset_creator.h"
+#include "benchmark_utils.h"
+
+using namespace anny;
+
+/*
+	HNSW build time and recall@10 vs number of build threads (1, 2, 4, ... up to hardware threads),
+	for simple and heuristic neighbor selection. Recall is measured against exact knn at fixed ef_search.
+*/
+
+constexpr size_t NUM_POINTS = 100000;
+constexpr size_t NUM_QUERIES = 1000;
+constexpr size_t DIM = 32;
+constexpr size_t TOP_N = 10;
+
+using Hnsw = HNSW<float, L2Distance>;
+
+double recall(const Hnsw& alg, const Matrix<float, MatrixStorageVV<float>>& queries, const KnnBatchResult<float>& expected)
+{
+	auto result = alg.knn_query_batch(queries, TOP_N);
+	size_t num_found = 0;
+	for (size_t q = 0; q < queries.num_rows(); q++)
+	{
+		auto first = expected.indices.begin() + q * TOP_N;
+		for (size_t j = 0; j < TOP_N; j++)
+			num_found += std::count(first, first + TOP_N, result.index(q, j));
+	}
+	return 1.0 * num_found / (TOP_N * queries.num_rows());
+}
+
+int main()
+{
+	auto data = utils::make_uniform<float>(NUM_POINTS, DIM, -1.0f, 1.0f);
+	auto query_rows = utils::make_uniform<float>(NUM_QUERIES, DIM, -1.0f, 1.0f);
+	Matrix<float, MatrixStorageVV<float>> queries{ MatrixStorageVV<float>(query_rows) };
+
+	VanillaKnn<float, L2Distance> exact;
+	exact.fit(data);
+	auto expected = exact.knn_query_batch(queries, TOP_N);
+
+	const size_t max_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+	std::vector<size_t> thread_counts;
+	for (size_t num_threads = 1; num_threads < max_threads; num_threads *= 2)
+		thread_counts.push_back(num_threads);
+	thread_counts.push_back(max_threads);
+
+	std::cout << NUM_POINTS << " points x " << DIM << " dims, M = 16, ef_construction = 100, ef_search = 50" << std::endl;
+	for (auto selection : { Hnsw::NeighborSelection::SIMPLE, Hnsw::NeighborSelection::HEURISTIC })
+	{
+		const std::string name = (selection == Hnsw::NeighborSelection::SIMPLE) ? "simple" : "heuristic";
+		for (size_t num_threads : thread_counts)
+		{
+			Hnsw alg(/*M*/ 16, /*efConstruction*/ 100, /*efSearch*/ 50, selection);
+			alg.set_num_build_threads(num_threads);
+			bench::Timer timer;
+			alg.fit(data);
+			double elapsed = timer.elapsed_seconds();
+
+			const std::string prefix = "  " + name + ", " + std::to_string(num_threads) + " threads";
+			bench::print_row(prefix + " build", elapsed, "s");
+			bench::print_row(prefix + " recall@10", 100.0 * recall(alg, queries, expected), "%");
+		}
+	}
+	return 0;
+}
\ No newline at end of file
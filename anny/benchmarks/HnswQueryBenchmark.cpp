@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "algs/hnsw.h"
+#include "algs/vanilla_knn.h"
+#include "utils/dataset_creator.h"
+#include "benchmark_utils.h"
+
+using namespace anny;
+
+/*
+	Single-threaded HNSW query throughput and recall@10 vs ef_search, for elements in insertion order
+	and after reorder() (breadth-first order of links).
+	The data is larger than the last level cache, so searches are bound by cache misses on links, visited marks and vectors.
+	The benchmark is built twice: with software prefetching in searches (default) and without it (ANNY_NO_PREFETCH),
+	run both executables to see the QPS delta of prefetching.
+*/
+
+constexpr size_t NUM_POINTS = 200000;
+constexpr size_t NUM_QUERIES = 1000;
+constexpr size_t DIM = 32;
+constexpr size_t TOP_N = 10;
+constexpr size_t NUM_PASSES = 3;  // best of
+
+using Hnsw = HNSW<float, L2Distance>;
+
+int main()
+{
+	auto data = utils::make_uniform<float>(NUM_POINTS, DIM, -1.0f, 1.0f);
+	auto query_rows = utils::make_uniform<float>(NUM_QUERIES, DIM, -1.0f, 1.0f);
+	Matrix<float, MatrixStorageVV<float>> queries{ MatrixStorageVV<float>(query_rows) };
+
+	VanillaKnn<float, L2Distance> exact;
+	exact.fit(data);
+	auto expected = exact.knn_query_batch(queries, TOP_N);
+
+	Hnsw alg(/*M*/ 16, /*efConstruction*/ 100, /*efSearch*/ 10);
+	alg.set_num_build_threads(std::max<size_t>(1, std::thread::hardware_concurrency()));
+	alg.fit(data);
+
+#ifdef ANNY_NO_PREFETCH
+	const std::string name = "no prefetch";
+#else
+	const std::string name = "prefetch";
+#endif
+	std::cout << NUM_POINTS << " points x " << DIM << " dims, M = 16, ef_construction = 100, " << name << std::endl;
+
+	Hnsw::QueryContext context;
+	std::vector<index_t> indices(NUM_QUERIES * TOP_N);
+	std::vector<float> distances(NUM_QUERIES * TOP_N);
+	auto measure = [&](const std::string& layout) {
+		for (size_t ef : { 10, 50, 100, 200 })
+		{
+			alg.set_ef_search(ef);
+			double best = 0.0;
+			for (size_t pass = 0; pass < NUM_PASSES; pass++)
+			{
+				bench::Timer timer;
+				for (size_t q = 0; q < NUM_QUERIES; q++)
+					alg.knn_query_into(queries[q].cbegin(), TOP_N, &indices[q * TOP_N], &distances[q * TOP_N], context);
+				best = std::max(best, NUM_QUERIES / timer.elapsed_seconds());
+			}
+			bench::do_not_optimize(indices);
+
+			size_t num_found = 0;
+			for (size_t q = 0; q < NUM_QUERIES; q++)
+			{
+				auto first = expected.indices.begin() + q * TOP_N;
+				for (size_t j = 0; j < TOP_N; j++)
+					num_found += std::count(first, first + TOP_N, indices[q * TOP_N + j]);
+			}
+
+			const std::string prefix = "  " + name + ", " + layout + ", ef " + std::to_string(ef);
+			bench::print_row(prefix + " QPS", best, "q/s");
+			bench::print_row(prefix + " recall@10", 100.0 * num_found / (TOP_N * NUM_QUERIES), "%");
+		}
+	};
+
+	measure("insertion order");
+	bench::Timer timer;
+	alg.reorder();
+	bench::print_row("  reorder", timer.elapsed_seconds(), "s");
+	measure("bfs order");
+	return 0;
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "core/matrix.h"
+#include "core/distance.h"
+#include "core/gemm.h"
+#include "core/pairwise_distances.h"
+#include "benchmark_utils.h"
+
+using namespace anny;
+
+/*
+	Many-to-many squared L2 distances (queries x dataset):
+	pairwise loop over distance_batch vs. GEMM-based pairwise_distances with built-in kernels (1 and all threads)
+	and with BLAS backend, if the library is built with it.
+*/
+
+Matrix<float> make_random_matrix(size_t rows, size_t cols, unsigned seed)
+{
+	std::default_random_engine gen(seed);
+	std::uniform_real_distribution<float> dis{ -1.0f, 1.0f };
+	Matrix<float> m(rows, cols);
+	for (size_t i = 0; i < rows; i++)
+		for (size_t j = 0; j < cols; j++)
+			m(i, j) = dis(gen);
+	return m;
+}
+
+double bench_distance_batch(const Matrix<float>& Q, const Matrix<float>& X)
+{
+	std::vector<float> out;
+	float sum = 0;
+	bench::Timer timer;
+	for (size_t i = 0; i < Q.num_rows(); i++)
+	{
+		distance_batch<L2SquaredDistance>(Q[i], X, 0, X.num_rows(), out);
+		sum += out.back();
+	}
+	double elapsed = timer.elapsed_seconds();
+	bench::do_not_optimize(sum);
+	return elapsed;
+}
+
+double bench_gemm_blocked(const Matrix<float>& Q, const Matrix<float>& X)
+{
+	std::vector<float> C(Q.num_rows() * X.num_rows());
+	bench::Timer timer;
+	gemm::gemm_nt_blocked(Q.num_rows(), X.num_rows(), Q.num_cols(), Q[0].cbegin(), Q.num_cols(), X[0].cbegin(), X.num_cols(), C.data(), X.num_rows());
+	double elapsed = timer.elapsed_seconds();
+	bench::do_not_optimize(C.back());
+	return elapsed;
+}
+
+double bench_pairwise_distances(const Matrix<float>& Q, const Matrix<float>& X, size_t num_threads)
+{
+	bench::Timer timer;
+	auto D = pairwise_distances<L2SquaredDistance>(Q, X, num_threads);
+	double elapsed = timer.elapsed_seconds();
+	bench::do_not_optimize(D(0, 0));
+	return elapsed;
+}
+
+int main()
+{
+	const size_t num_queries = 1000;
+	const size_t num_points = 10000;
+
+	for (size_t dim : { 32, 128, 960 })
+	{
+		auto Q = make_random_matrix(num_queries, dim, 1);
+		auto X = make_random_matrix(num_points, dim, 2);
+
+		const double num_pairs = 1.0 * num_queries * num_points;
+		std::cout << "dim = " << dim << ", " << num_queries << " queries x " << num_points << " points" << std::endl;
+		bench::print_row("  distance_batch per query", bench_distance_batch(Q, X) * 1e9 / num_pairs, "ns/pair");
+		bench::print_row("  built-in GEMM, 1 thread", bench_gemm_blocked(Q, X) * 1e9 / num_pairs, "ns/pair");
+		bench::print_row(std::string("  pairwise_distances") + (gemm::uses_blas<float>() ? " (BLAS)" : ""),
+			bench_pairwise_distances(Q, X, 0) * 1e9 / num_pairs, "ns/pair");
+	}
+	return 0;
+}
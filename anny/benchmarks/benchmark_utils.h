@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+
+namespace anny
+{
+namespace bench
+{
+	class Timer
+	{
+	public:
+		Timer()
+			: m_start{ std::chrono::steady_clock::now() }
+		{}
+
+		double elapsed_seconds() const
+		{
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+		}
+
+	private:
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	// prevents compiler from optimizing away a computed value
+	template <typename T>
+	inline void do_not_optimize(const T& value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile T sink;
+		sink = value;
+#endif
+	}
+
+	inline void print_row(const std::string& name, double value, const std::string& unit)
+	{
+		std::cout << std::left << std::setw(48) << name << std::right << std::setw(12) << std::fixed << std::setprecision(2) << value << " " << unit << std::endl;
+	}
+
+}
+}
@@ -11,6 +11,7 @@
 #include "../core/matrix.h"
 #include "../core/distance.h"
 #include "../core/hyperplane.h"
+#include "../core/mips_transform.h"
 #include "../utils/utils_defs.h"
 
 
@@ -30,11 +31,22 @@ namespace anny
 
 		~Annoy() override {}
 
-		void fit(const std::vector<std::vector<T>>& data) override;
-		IndexVector knn_query(const std::vector<T>& vec, size_t k) override;
-		IndexVector radius_query(const std::vector<T>& vec, T radius) override;
+		using typename IKnnAlgorithm<T>::DataMatrix;
+		using IKnnAlgorithm<T>::fit;
+
+		void fit(DataMatrix&& data) override;
+
+	protected:
+		using typename IKnnAlgorithm<T>::KnnResult;
+
+		KnnResult knn_search(VecView<const T> query, size_t k) const override;
+		KnnResult radius_search(VecView<const T> query, T radius) const override;
 
 	private:
+		// MIPS is reduced to L2 search over augmented data, so splitting hyperplanes stay meaningful (see MipsTransform)
+		static constexpr bool IS_MIPS = std::is_same_v<Dist, anny::InnerProductDistance>;
+		using SearchDist = SearchDistance<std::conditional_t<IS_MIPS, anny::L2Distance, Dist>>;
+
 		struct Node;
 		using NodePtr = std::unique_ptr<Node>;
 
@@ -83,7 +95,7 @@ namespace anny
 		class KnnQueryNodeVisitor : public NodeVisitor
 		{
 		public:
-			KnnQueryNodeVisitor(Annoy<T, Dist>* context, VecView<T> vec, size_t k)
+			KnnQueryNodeVisitor(const Annoy<T, Dist>* context, VecView<T> vec, size_t k)
 				: m_context(context)
 				, m_vec(vec)
 				, m_k(k)
@@ -122,7 +134,7 @@ namespace anny
 
 		private:
 			std::unordered_set<anny::index_t> m_candidates;
-			Annoy<T, Dist>* m_context;
+			const Annoy<T, Dist>* m_context;
 			VecView<T> m_vec;
 			size_t m_k;
 		};
@@ -131,7 +143,7 @@ namespace anny
 		class RadiusQueryNodeVisitor : public NodeVisitor
 		{
 		public:
-			RadiusQueryNodeVisitor(Annoy<T, Dist>* context, VecView<T> vec, T radius)
+			RadiusQueryNodeVisitor(const Annoy<T, Dist>* context, VecView<T> vec, T radius)
 				: m_context(context)
 				, m_vec(vec)
 				, m_radius(radius)
@@ -158,7 +170,8 @@ namespace anny
 			{
 				std::vector<anny::index_t> indices(m_candidates.begin(), m_candidates.end()); // copying here
 				auto result = m_context->calc_distances(m_vec, indices);
-				auto it = std::upper_bound(result.begin(), result.end(), m_radius, [](T value, const auto& item)
+				const T search_radius = SearchDist::from_distance(m_radius);
+				auto it = std::upper_bound(result.begin(), result.end(), search_radius, [](T value, const auto& item)
 					{
 						return value < item.first;
 					});
@@ -178,7 +191,7 @@ namespace anny
 
 		private:
 			std::unordered_set<anny::index_t> m_candidates;
-			Annoy<T, Dist>* m_context;
+			const Annoy<T, Dist>* m_context;
 			VecView<T> m_vec;
 			T m_radius;
 		};
@@ -186,17 +199,18 @@ namespace anny
 
 		bool split(const IndexVector& indices, SplitResult& result);
 		NodePtr build_annoy_tree(const IndexVector& indices);
-		T calc_distance(VecView<T> vec, index_t index);
-		std::vector<std::pair<T, index_t>> calc_distances(VecView<T> vec, const IndexVector& indices);
-		void traverse(VecView<T> vec, NodeVisitor& visitor);
+		T calc_distance(VecView<T> vec, index_t index) const;
+		T to_index_distance(T search_distance, T query_norm_squared) const;
+		std::vector<std::pair<T, index_t>> calc_distances(VecView<T> vec, const IndexVector& indices) const;
+		void traverse(VecView<T> vec, NodeVisitor& visitor) const;
 
 	private:
-		Matrix<T, MatrixStorageVV<T>> m_data;
+		DataMatrix m_data;
 		std::vector<NodePtr> m_forest;
 		size_t m_num_trees;
 		size_t m_leaf_size;
 		std::mt19937 m_gen;
-		Dist m_dist_func;
+		MipsTransform<T> m_mips;
 	};
 
 
@@ -276,16 +290,20 @@ namespace anny
 
 
 	template <typename T, typename Dist>
-	void Annoy<T, Dist>::fit(const std::vector<std::vector<T>>& data)
+	void Annoy<T, Dist>::fit(DataMatrix&& data)
 	{
-		MatrixStorageVV<T> storage(data);
-		Matrix<T, MatrixStorageVV<T>> m(storage);
-		m_data = std::move(m);
+		m_data = std::move(data);
 
 		if constexpr (std::is_same_v<Dist, anny::CosineDistance>)
 		{
+			if (!m_data.storage().owns_exclusively())
+				m_data = DataMatrix(m_data.storage().clone());  // borrowed, shared or mapped memory is read-only
 			anny::l2_normalize_inplace(m_data);
 		}
+		if constexpr (IS_MIPS)
+		{
+			m_data = m_mips.fit_transform(m_data);
+		}
 
 		IndexVector all_indices(m_data.num_rows());
 		std::iota(all_indices.begin(), all_indices.end(), 0);
@@ -300,22 +318,24 @@ namespace anny
 	}
 
 	template <typename T, typename Dist>
-	T Annoy<T, Dist>::calc_distance(VecView<T> vec, index_t index)
+	T Annoy<T, Dist>::calc_distance(VecView<T> vec, index_t index) const
 	{
-		return this->m_dist_func(m_data[index], vec);
+		return distance_to_row<typename SearchDist::type>(vec, m_data, index);
 	}
 
 
 	template <typename T, typename Dist>
-	std::vector<std::pair<T, index_t>> Annoy<T, Dist>::calc_distances(VecView<T> vec, const IndexVector& indices)
+	std::vector<std::pair<T, index_t>> Annoy<T, Dist>::calc_distances(VecView<T> vec, const IndexVector& indices) const
 	{
-		assert(m_data[0].is_same_size(vec));
+		assert(m_data.num_cols() == vec.size());
 
-		std::vector<std::pair<T, index_t>> distances;
+		std::vector<T> batch;
+		distance_batch<typename SearchDist::type>(vec, m_data, indices, batch);
 
-		for (const auto& index : indices)
+		std::vector<std::pair<T, index_t>> distances(indices.size());
+		for (size_t i = 0; i < indices.size(); i++)
 		{
-			distances.push_back({ this->m_dist_func(m_data[index], vec), index});
+			distances[i] = { batch[i], indices[i] };
 		}
 
 		std::stable_sort(distances.begin(), distances.end());
@@ -325,7 +345,7 @@ namespace anny
 
 
 	template <typename T, typename Dist>
-	void Annoy<T, Dist>::traverse(VecView<T> vec, NodeVisitor& visitor)
+	void Annoy<T, Dist>::traverse(VecView<T> vec, NodeVisitor& visitor) const
 	{
 		// MaxHeap will sort nodes by margin in that way that we will always take node with the biggest positive margin
 		std::priority_queue<std::pair<T, Annoy<T, Dist>::Node*>> pq;
@@ -360,17 +380,28 @@ namespace anny
 	}
 
 
+	// converts distance from search space back to distance of the index
+	template <typename T, typename Dist>
+	T Annoy<T, Dist>::to_index_distance(T search_distance, T query_norm_squared) const
+	{
+		if constexpr (IS_MIPS)
+			return m_mips.from_l2_squared(search_distance, query_norm_squared);
+		else
+			return SearchDist::to_distance(search_distance);
+	}
+
+
 	template <typename T, typename Dist>
-	IndexVector Annoy<T, Dist>::knn_query(const std::vector<T>& vec, size_t k)
+	typename Annoy<T, Dist>::KnnResult Annoy<T, Dist>::knn_search(VecView<const T> vec, size_t k) const
 	{
-		IndexVector result;
+		KnnResult result;
 		if (k == 0)
 			return result;
 
 		const auto N = m_data.num_rows();
 		k = (k > N) ? N : k;
 
-		Vec<T> query(vec);
+		Vec<T> query = IS_MIPS ? m_mips.transform_query(vec) : Vec<T>(vec);
 		
 		if constexpr (std::is_same_v<Dist, anny::CosineDistance>)
 		{
@@ -383,7 +414,10 @@ namespace anny
 		traverse(query.view(), visitor);
 		auto candidates_vec = visitor.get_result();
 		size_t actual_k = std::min(k, candidates_vec.size());
-		std::transform(candidates_vec.begin(), candidates_vec.begin() + actual_k, std::back_inserter(result), [](auto el) { return el.second; });
+		const T query_norm_squared = IS_MIPS ? l2_norm_squared(query.view()) : T{ 0 };
+		std::transform(candidates_vec.begin(), candidates_vec.begin() + actual_k, std::back_inserter(result), [this, query_norm_squared](auto el) {
+			return std::make_pair(el.second, to_index_distance(el.first, query_norm_squared));
+			});
 
 		return result;
 
@@ -391,21 +425,32 @@ namespace anny
 
 
 	template <typename T, typename Dist>
-	IndexVector Annoy<T, Dist>::radius_query(const std::vector<T>& vec, T radius)
+	typename Annoy<T, Dist>::KnnResult Annoy<T, Dist>::radius_search(VecView<const T> vec, T radius) const
 	{
-		IndexVector result;
+		KnnResult result;
 
-		Vec<T> query(vec);
+		Vec<T> query = IS_MIPS ? m_mips.transform_query(vec) : Vec<T>(vec);
 		if constexpr (std::is_same_v<Dist, anny::CosineDistance>)
 		{
 			anny::l2_normalize_inplace(query.view());
 		}
+		if constexpr (IS_MIPS)
+		{
+			// margins to splitting hyperplanes are measured in augmented L2 space, so is the radius
+			T l2_radius_squared = m_mips.to_l2_squared(radius, l2_norm_squared(query.view()));
+			if (l2_radius_squared < 0)
+				return result;  // no inner product can be that big
+			radius = std::sqrt(l2_radius_squared);
+		}
 
 		RadiusQueryNodeVisitor visitor(this, query.view(), radius);
 
 		traverse(query.view(), visitor);
 		auto candidates_vec = visitor.get_result();
-		std::transform(candidates_vec.begin(), candidates_vec.end(), std::back_inserter(result), [](auto el) { return el.second; });
+		const T query_norm_squared = IS_MIPS ? l2_norm_squared(query.view()) : T{ 0 };
+		std::transform(candidates_vec.begin(), candidates_vec.end(), std::back_inserter(result), [this, query_norm_squared](auto el) {
+			return std::make_pair(el.second, to_index_distance(el.first, query_norm_squared));
+			});
 
 		return result;
 
@@ -1,137 +1,468 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <limits>
+#include <optional>
 #include <random>
-#include <unordered_set>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include "knn_abc.h"
 #include "../core/vec_view.h"
 #include "../core/matrix.h"
+#include "../core/mapped_file.h"
 #include "../core/distance.h"
 #include "../core/graph.h"
+#include "../core/hnsw_graph.h"
 #include "../utils/utils_defs.h"
+#include "../utils/bitset.h"
 #include "../utils/progress_bar.h"
+#include "../utils/spinlock.h"
+#include "../utils/thread_pool.h"
+#include "../utils/visited_list_pool.h"
 
 
 
 namespace anny
 {
 
+	/*
+		Binary HNSW index file: 256-byte header with parameters of the index, then sections one after another,
+		each starts at a multiple of 64 bytes: flat link arrays of HnswGraph as they are in memory, states of elements
+		data rows padded to 64 bytes like in MatrixStorageAligned and indices of reordered elements. So a mapped file
+		is used by the index in place, without parsing, and data rows are cache line aligned.
+		Version 2 added the external ids section, version 1 files have no reordered elements and are read as is.
+	*/
+	struct HnswFileHeader
+	{
+		static constexpr char MAGIC[8] = { 'A', 'N', 'N', 'Y', 'H', 'N', 'S', 'W' };
+		static constexpr uint32_t VERSION = 2;
+		static constexpr size_t SECTION_ALIGNMENT = 64;
+
+		enum Section
+		{
+			LEVELS,         // HnswGraph arrays, in the order of HnswGraph::raw_arrays()
+			UPPER_OFFSETS,
+			LEVEL0_LINKS,
+			UPPER_LINKS,
+			NODE_STATES,    // uint8 per element
+			DATA,           // num_elements rows of row_stride elements, padding is zeros
+			EXTERNAL_IDS,   // uint64 index seen by users per element, empty if elements are not reordered
+			NUM_SECTIONS
+		};
+
+		struct SectionInfo
+		{
+			uint64_t offset;  // bytes from the start of the file
+			uint64_t size;    // bytes
+		};
+
+		char magic[8];
+		uint32_t version;
+		uint32_t elem_size;  // sizeof(T)
+		uint64_t distance_id;  // DistanceId of Dist
+		uint64_t M;
+		uint64_t Mmax0;
+		uint64_t ef_construction;
+		uint64_t ef_search;
+		uint8_t neighbor_selection;
+		uint8_t extend_candidates;
+		uint8_t keep_pruned_connections;
+		uint8_t reserved0;
+		int32_t max_level;
+		uint64_t entry_point;
+		uint64_t num_elements;
+		uint64_t num_deleted;
+		uint64_t cols;
+		uint64_t row_stride;
+		SectionInfo sections[NUM_SECTIONS];
+		uint8_t reserved[40];
+	};
+	static_assert(sizeof(HnswFileHeader) == 256);
+
+
 	template <typename T, typename Dist = L2Distance>
 	class HNSW: public IKnnAlgorithm<T>
 	{
 	public:
-		HNSW(size_t M=16, size_t ef_construction=100, size_t ef_search=100)
-			: m_gen{ std::mt19937(777) }
+		/*
+			How neighbors of an element are selected from the candidates found at construction time:
+			SIMPLE - M nearest candidates (Algorithm 3 of the HNSW paper).
+			HEURISTIC - a candidate is kept only if it is closer to the element than to any neighbor kept before (Algorithm 4).
+			It keeps links to other directions/clusters instead of M links into one dense region, so the same recall
+			is reached with smaller ef_search, especially on clustered data.
+			extend_candidates adds neighbors of the candidates to the candidates, keep_pruned_connections fills
+			the rest of M links with the pruned candidates (both are options of Algorithm 4, used by HEURISTIC only).
+		*/
+		enum class NeighborSelection
+		{
+			SIMPLE,
+			HEURISTIC
+		};
+
+		HNSW(size_t M=16, size_t ef_construction=100, size_t ef_search=100,
+			NeighborSelection neighbor_selection = NeighborSelection::SIMPLE,
+			bool extend_candidates = false, bool keep_pruned_connections = false)
+			: m_graph{ 2 * M, M }
+			, m_gen{ std::mt19937(777) }
 			, m_M{M}                             // number of element's neighbors at construction time
 			, m_Mmax0{ 2 * M }                   // max number of element's neighbors at level 0
 			, m_efConstruction{ef_construction}  // ef stands for "expansion factor"
 			, m_efSearch{ef_search}
 			, m_mL { 1.0 / log(1.0 * M) }        // norm factor to calc random level for an element
-		{}
+			, m_neighborSelection{ neighbor_selection }
+			, m_extendCandidates{ extend_candidates }
+			, m_keepPrunedConnections{ keep_pruned_connections }
+		{
+			if (M < 2)
+				throw std::runtime_error("HNSW needs M >= 2");  // levels are drawn with norm factor 1 / ln(M)
+		}
 
 		~HNSW() override {}
 
-		void fit(const std::vector<std::vector<T>>& data) override;
-		IndexVector knn_query(const std::vector<T>& vec, size_t k) override;
-		IndexVector radius_query(const std::vector<T>& vec, T radius) override;
+		using typename IKnnAlgorithm<T>::DataMatrix;
+		using typename IKnnAlgorithm<T>::KnnResult;
+		using IKnnAlgorithm<T>::fit;
+		using IKnnAlgorithm<T>::knn_query;
+		using IKnnAlgorithm<T>::knn_query_with_distances;
 
+		void fit(DataMatrix&& data) override;
 		void set_ef_search(size_t ef) { m_efSearch = ef; }
 		size_t get_ef_search() const noexcept { return m_efSearch; }
 
+		/*
+			Number of threads inserting elements in fit() (0 - use all hardware threads, default is 1).
+			Threads insert elements concurrently, locking only the links of the node being read or updated,
+			and the entry point only when an element gets a new top level. Element levels are drawn before insertion,
+			so a single threaded build is deterministic, a multithreaded one depends on the order threads insert elements.
+		*/
+		void set_num_build_threads(size_t num_threads) { m_numBuildThreads = num_threads; }
+		size_t get_num_build_threads() const noexcept { return m_numBuildThreads; }
+
+		/*
+			Adds rows of items to the index after fit() (or to the empty index), returns indices of the items.
+			Items take slots of deleted elements freed by repair() first, the rest get the next indices
+			(num_elements() before the call and so on). Rows are written to the index data
+			and inserted into the existing graph by get_num_build_threads() threads. Data borrowed by the index
+			(zero-copy fit) is copied into own memory on the first call. Memory for data and links grows twice
+			when it is exhausted, reserve() it in advance to avoid reallocations.
+		*/
+		template <typename Storage>
+		IndexVector add_items(const Matrix<T, Storage>& items);
+
+		// makes room for capacity elements, so that add_items() up to this size does not reallocate data and links
+		void reserve(size_t capacity);
+
+		size_t num_elements() const noexcept { return m_data.num_rows(); }
+
+		/*
+			save() writes the index into a binary file (see HnswFileHeader), it may run concurrently with queries.
+			load() maps the file and serves queries from it right away: links and data are used in place,
+			pages are read by the OS on first access (advice hints the expected access to the whole file).
+			Parameters of the index (M, ef, neighbor selection) are replaced by the saved ones.
+			The mapping is private: the file is never modified, links and data are copied into own memory when items are added.
+		*/
+		void save(const std::string& path) const;
+		void load(const std::string& path, MappedFile::Advice advice = MappedFile::Advice::NORMAL);
+
+		/*
+			Soft deletion. A deleted element stays in the graph and searches still go through it, so the graph
+			stays connected, but queries never return it. repair() unlinks deleted elements: links to them are replaced
+			by links to the nearest alive elements reachable through them, and their slots are reused by add_items().
+			Like fit(), these must not run concurrently with queries.
+		*/
+		void mark_deleted(index_t index);
+		bool is_deleted(index_t index) const
+		{
+			if (index >= m_data.num_rows())
+				throw std::runtime_error("Index is out of range");
+			return m_nodeStates[to_internal(index)] != NodeState::ALIVE;
+		}
+		size_t num_deleted() const noexcept { return m_numDeleted; }  // including freed slots not reused yet
+		void repair();
+
+		/*
+			Renumbers elements in breadth-first order of level 0 links from the entry point (see bfs_order()),
+			so that linked elements get close numbers and searches touch fewer cache lines and pages.
+			Rows of data (copied into own memory), links and states of elements are permuted, while indices seen
+			by users do not change: queries, add_items(), mark_deleted() and filters keep using the original indices.
+			An offline pass: like fit(), it must not run concurrently with queries.
+		*/
+		void reorder();
+
+		/*
+			Scratch memory of a query: candidates and results heaps, neighbors batch buffers, padded query (visited marks come from the pool of the index).
+			Buffers grow during the first queries and are reused afterwards, so steady-state queries
+			through knn_query_into do no heap allocations. A context is not thread-safe: keep one per thread.
+		*/
+		class QueryContext
+		{
+		public:
+			QueryContext() = default;
+
+		private:
+			friend class HNSW<T, Dist>;
+
+			std::vector<std::pair<T, index_t>> m_candidates;  // min heap of elements to expand
+			std::vector<std::pair<T, index_t>> m_nearest;  // max heap of found nearest elements, sorted by distance after search_layer
+			IndexVector m_unvisited;
+			std::vector<T> m_unvisitedDistances;
+			std::vector<T> m_query;  // query padded to the row stride of the data once per search
+		};
+
+		/*
+			knn query writing up to k nearest neighbors, nearest first, into caller buffers indices[0..k) and
+			distances[0..k) (distances may be nullptr), returns the number of neighbors written.
+			query has num_cols elements of the data. With a reused context it does no heap allocations.
+		*/
+		size_t knn_query_into(const T* query, size_t k, index_t* indices, T* distances, QueryContext& context) const;
+
+		/*
+			Filtered knn queries: only elements allowed by filter are returned. filter is an allow-list (utils::Bitset)
+			or a predicate bool(index_t). The search goes through filtered out elements as through deleted ones,
+			so the graph stays connected for it, and goes on until max(ef_search, k) allowed elements are collected:
+			the more selective the filter, the wider the search. When allowed elements are so rare that the graph search
+			would compute more distances than there are allowed elements (num_allowed^2 <= ef * num_elements,
+			num_allowed of a predicate is estimated on a sample of elements), they are scanned exactly instead.
+		*/
+		template <typename Filter>
+		IndexVector knn_query(const std::vector<T>& vec, size_t k, const Filter& filter) const
+		{
+			return this->indices_of(knn_query_with_distances(vec, k, filter));
+		}
+
+		template <typename Filter>
+		KnnResult knn_query_with_distances(const std::vector<T>& vec, size_t k, const Filter& filter) const
+		{
+			return search_result(VecView<const T>(vec.data(), vec.size()), k, filter);
+		}
+
+		template <typename Filter>
+		size_t knn_query_into(const T* query, size_t k, index_t* indices, T* distances, QueryContext& context, const Filter& filter) const;
+
+	protected:
+		KnnResult knn_search(VecView<const T> query, size_t k) const override;
+		KnnResult radius_search(VecView<const T> query, T radius) const override;
+
 	private:
 		// aliases
+		using SearchDist = SearchDistance<Dist>;  // distances inside the graph are compared in search space
 		using DI = anny::utils::DistIndexPair<T, index_t>;
 		using PQ = anny::utils::UniqueFixedSizePriorityQueue<anny::utils::DistIndexPair<T, Dist>>;
 		using level_t = int;
 
+		enum class NodeState : uint8_t
+		{
+			ALIVE,
+			DELETED,  // in the graph, not returned by queries
+			FREE      // unlinked by repair(), slot waits for reuse
+		};
+
+		// filter of unfiltered searches
+		struct AllowAll
+		{
+			constexpr bool operator()(index_t) const noexcept { return true; }
+		};
+
 		// constants
-		static constexpr level_t MAX_LAYERS = 8;  // simulations show that for 5 <= M <= 100 (most use-cases), MAX_LAYERS < 8
+		static constexpr level_t MAX_LAYERS = HnswGraph::MAX_LEVEL;  // simulations show that for 5 <= M <= 100 (most use-cases), MAX_LAYERS < 8
+		static constexpr size_t FILTER_SAMPLE_SIZE = 1000;  // elements checked to estimate selectivity of a predicate
+#ifdef ANNY_NO_PREFETCH
+		static constexpr bool PREFETCH = false;
+#else
+		static constexpr bool PREFETCH = true;  // software prefetching in search_layer, turned off by ANNY_USE_PREFETCH=OFF in CMake
+#endif
+		static constexpr size_t PREFETCH_ROWS = 4;  // rows of the first block of distance_batch
 
 		// functions
-		std::vector<DI> search_layer(VecView<T> q, const IndexVector& ep, size_t ef, size_t lc);
-		void insert(index_t index);
-		IndexVector select_neighbors(std::vector<DI> neighbors, size_t M, bool is_sorted=true) const noexcept;
-		void shrink_connections(index_t index, size_t lc, size_t M);
+		template <bool LockLinks, typename Collect = AllowAll>
+		void search_layer(VecView<const T> q, index_t ep, size_t ef, level_t lc, QueryContext& context, utils::VisitedList& visited, const Collect& is_collected = Collect{}) const;
+		index_t search_upper_layers(VecView<const T> q, QueryContext& context, utils::VisitedList& visited) const;
+		template <typename Filter>
+		size_t search(VecView<const T> q, size_t k, QueryContext& context, const Filter& filter) const;
+		template <typename Filter>
+		size_t search_exact(VecView<const T> q, size_t k, QueryContext& context, const Filter& filter) const;
+		template <typename Filter>
+		KnnResult search_result(VecView<const T> q, size_t k, const Filter& filter) const;
+		template <typename Filter>
+		bool is_allowed(const Filter& filter, index_t index) const;
+		template <typename Filter>
+		size_t estimate_num_allowed(const Filter& filter) const;
+		void insert(index_t index, QueryContext& context);
+		void insert_elements(const IndexVector& indices, bool show_progress);
+		IndexVector select_neighbors(const std::vector<DI>& candidates, size_t M) const;
+		IndexVector select_neighbors_simple(std::vector<DI> neighbors, size_t M, bool is_sorted=true) const noexcept;
+		IndexVector select_neighbors_heuristic(const std::vector<DI>& candidates, size_t M) const;
+		void extend_candidates(VecView<const T> q, level_t lc, std::vector<DI>& candidates, utils::VisitedList& visited) const;
+		void add_link(index_t index, level_t lc, index_t link);
 		void clear();
 		level_t get_random_level();
 		bool is_hnsw_empty() const noexcept;
-		IndexVector knn_search(VecView<T> q, size_t k);
+		static const char* validate(const HnswFileHeader& header, size_t file_size);
+
+		T calc_distance(VecView<const T> vec, index_t index) const;
+		std::vector<DI> calc_distances(VecView<const T> vec, const IndexVector& indices) const;
 
-		T calc_distance(VecView<T> vec, index_t index);
-		std::vector<DI> calc_distances(VecView<T> vec, const IndexVector& indices);
+		// elements are numbered internally, users see the numbers they had before reorder()
+		index_t to_external(index_t index) const noexcept { return m_externalIds.empty() ? index : m_externalIds[index]; }
+		index_t to_internal(index_t index) const noexcept { return m_internalIds.empty() ? index : m_internalIds[index]; }
 
 	private:
-		Matrix<T, MatrixStorageVV<T>> m_data;
-		std::vector<Graph<index_t>> m_layers;
-		std::vector<level_t> m_elementLevels;
+		DataMatrix m_data;
+		HnswGraph m_graph;
 		std::mt19937 m_gen;
-		Dist m_dist_func;
 		size_t m_M{ 0 };
 		size_t m_Mmax0{ 0 };
 		size_t m_efConstruction{ 0 };
 		size_t m_efSearch{ 0 };
 		double m_mL{ 0 };
+		NeighborSelection m_neighborSelection{ NeighborSelection::SIMPLE };
+		bool m_extendCandidates{ false };
+		bool m_keepPrunedConnections{ false };
 		level_t m_maxLevel{ -1 };   // curr max level (top level) during construction
 		index_t m_entryPoint{ 0 }; // curr entry point at top level during construction
+		mutable utils::VisitedListPool m_visitedPool;  // visited marks for searches running at the same time
+		size_t m_numBuildThreads{ 1 };
+		mutable std::vector<utils::Spinlock> m_linkLocks;  // per node, guards its links at all levels during build
+		std::mutex m_entryPointMutex;  // guards m_maxLevel and m_entryPoint during build
+		std::vector<NodeState> m_nodeStates;
+		size_t m_numDeleted{ 0 };
+		IndexVector m_freeSlots;  // deleted elements unlinked by repair()
+		IndexVector m_externalIds;  // index seen by users of each element, empty until reorder()
+		IndexVector m_internalIds;  // element of each index seen by users, empty until reorder()
 	};
 
 
 	template <typename T, typename Dist>
 	void HNSW<T, Dist>::clear()
 	{
-		m_layers.clear();
-		m_elementLevels.clear();
+		m_graph = HnswGraph(m_Mmax0, m_M);
+		m_linkLocks.clear();
+		m_nodeStates.clear();
+		m_numDeleted = 0;
+		m_freeSlots.clear();
+		m_externalIds.clear();
+		m_internalIds.clear();
+		m_maxLevel = -1;
+		m_entryPoint = 0;
 	}
 
 
+	/*
+		Searches layer lc starting from ep, ef nearest elements found are left in context.m_nearest sorted by distance.
+		Elements not passing is_collected (deleted, filtered out) are expanded, but not collected,
+		so context.m_nearest may be even empty.
+		During build links of the node being expanded are read under its lock (LockLinks), queries need no locks.
+	*/
 	template <typename T, typename Dist>
-	std::vector<typename HNSW<T, Dist>::DI> HNSW<T, Dist>::search_layer(VecView<T> q, const IndexVector& ep, size_t ef, size_t lc)
+	template <bool LockLinks, typename Collect>
+	void HNSW<T, Dist>::search_layer(VecView<const T> q, index_t ep, size_t ef, level_t lc, QueryContext& context, utils::VisitedList& visited, const Collect& is_collected) const
 	{
-		std::unordered_set<index_t> visited;
+		constexpr bool COLLECT_ALL = std::is_same_v<Collect, AllowAll>;
+
+		visited.reset();
 
 		auto PQGreater = [](const DI& left, const DI& right) {
 			return left.first > right.first;
 		};
-		std::priority_queue<DI, std::vector<DI>, decltype(PQGreater)> candidates{ PQGreater };  // min heap
-		anny::utils::FixedSizePriorityQueue<DI> w{ ef };  // found nearest neighbors
+		auto& candidates = context.m_candidates;  // min heap
+		auto& w = context.m_nearest;  // found nearest neighbors, max heap of at most ef elements
+		candidates.clear();
+		w.clear();
+
+		// adds to w, replacing the farthest element when w is full
+		auto push_nearest = [&w, ef](const DI& value) {
+			if (w.size() >= ef)
+			{
+				if (w.front() < value)
+					return;
+				std::pop_heap(w.begin(), w.end());
+				w.pop_back();
+			}
+			w.push_back(value);
+			std::push_heap(w.begin(), w.end());
+		};
 
-		for (const auto& index : ep)
-		{
-			visited.insert(index);
-			auto dist_epq = calc_distance(q, index);
-			candidates.push({ dist_epq, index });
-			w.push({ dist_epq, index });
-		}
+		auto farthest_distance = [&w]() {
+			return w.empty() ? std::numeric_limits<T>::max() : w.front().first;
+		};
 
+		visited.visit(ep);
+		auto dist_epq = calc_distance(q, ep);
+		candidates.push_back({ dist_epq, ep });
+		if (is_collected(ep))
+			push_nearest({ dist_epq, ep });
+
+		auto& unvisited = context.m_unvisited;
+		auto& unvisited_distances = context.m_unvisitedDistances;
 		while (!candidates.empty())
 		{
-			auto [dist_cq, c] = candidates.top();
-			candidates.pop();
-			auto dist_fq = w.top().first;
+			std::pop_heap(candidates.begin(), candidates.end(), PQGreater);
+			auto [dist_cq, c] = candidates.back();
+			candidates.pop_back();
+			auto dist_fq = farthest_distance();
 
 			// All candidates are worse than collected nearest neighbors by now. Stop.
-			if (dist_cq > dist_fq)
+			// When elements are skipped, the search goes on until ef elements are collected
+			if (dist_cq > dist_fq && (COLLECT_ALL || w.size() >= ef))
 				break;
 
-			for (const auto& e : m_layers[lc].get_adj_vertices(c))
+			// links of the next candidate are loaded while this one is expanded
+			if (PREFETCH && !candidates.empty())
+				m_graph.prefetch_links(static_cast<HnswGraph::id_t>(candidates.front().second), lc);
+
+			// gather not visited neighbors first to calc their distances in one batch
+			unvisited.clear();
 			{
-				if (auto it = visited.find(e); it != visited.end())
-					continue;
-				visited.insert(e);
+				std::unique_lock<utils::Spinlock> lock;
+				if constexpr (LockLinks)
+					lock = std::unique_lock<utils::Spinlock>(m_linkLocks[c]);
+				const auto links = m_graph.links(static_cast<HnswGraph::id_t>(c), lc);
+				if constexpr (PREFETCH)
+				{
+					// marks of neighbors are scattered over the visited list, all of them are requested before the first is checked
+					for (const auto& e : links)
+						visited.prefetch(e);
+				}
+				for (const auto& e : links)
+				{
+					if (visited.visit(e))
+					{
+						unvisited.push_back(e);
+						// the first rows of the batch, later ones are prefetched by distance_batch itself
+						if (PREFETCH && unvisited.size() <= PREFETCH_ROWS)
+							simd::prefetch_array(m_data[e].cbegin(), m_data.num_cols());
+					}
+				}
+			}
+			distance_batch<typename SearchDist::type>(q, m_data, unvisited, unvisited_distances);
 
-				auto dist_eq = calc_distance(q, e);
-				auto dist_fq = w.top().first;
+			for (size_t i = 0; i < unvisited.size(); i++)
+			{
+				auto e = unvisited[i];
+				auto dist_eq = unvisited_distances[i];
+				auto dist_fq = farthest_distance();
 				if (dist_eq < dist_fq || w.size() < ef)
 				{
-					candidates.push({ dist_eq, e });
-					w.push({ dist_eq, e });
+					candidates.push_back({ dist_eq, e });
+					std::push_heap(candidates.begin(), candidates.end(), PQGreater);
+					if (is_collected(e))
+						push_nearest({ dist_eq, e });
 				}
 			}
 		}
 
-		return anny::utils::pq2vec(std::move(w));
+		std::sort_heap(w.begin(), w.end());
 	}
 
 
@@ -149,15 +480,22 @@ namespace anny
 	template <typename T, typename Dist>
 	bool HNSW<T, Dist>::is_hnsw_empty() const noexcept
 	{
-		if (m_layers.empty())
-			return true;
+		return m_maxLevel == -1;
+	}
+
 
-		return m_layers.front().is_empty();  // layer 0 contains all existing vertices
+	// candidates are sorted by distance to the element
+	template <typename T, typename Dist>
+	IndexVector HNSW<T, Dist>::select_neighbors(const std::vector<DI>& candidates, size_t M) const
+	{
+		if (m_neighborSelection == NeighborSelection::HEURISTIC)
+			return select_neighbors_heuristic(candidates, M);
+		return select_neighbors_simple(candidates, M);
 	}
 
 
 	template <typename T, typename Dist>
-	IndexVector HNSW<T, Dist>::select_neighbors(std::vector<DI> neighbors, size_t M, bool is_sorted) const noexcept
+	IndexVector HNSW<T, Dist>::select_neighbors_simple(std::vector<DI> neighbors, size_t M, bool is_sorted) const noexcept
 	{
 		if (!is_sorted)
 		{
@@ -172,36 +510,94 @@ namespace anny
 	}
 
 
+	// candidates are sorted by distance to the element
 	template <typename T, typename Dist>
-	void HNSW<T, Dist>::shrink_connections(index_t index, size_t lc, size_t M)
+	IndexVector HNSW<T, Dist>::select_neighbors_heuristic(const std::vector<DI>& candidates, size_t M) const
 	{
-		const auto& neighbors_indices = m_layers[lc].get_adj_vertices(index);
-		VecView<T> vec = m_data[index];
-		auto neighbors_with_distances = calc_distances(vec, neighbors_indices);
-		IndexVector selected_neighbors = select_neighbors(neighbors_with_distances, M, /*is_sorted*/ true);
-		for (const auto& n : neighbors_indices)
+		IndexVector result;
+		IndexVector pruned;
+		result.reserve(M);
+		for (const auto& [dist_eq, e] : candidates)
 		{
-			if (auto it = std::find(selected_neighbors.begin(), selected_neighbors.end(), n); it == selected_neighbors.end())
-				m_layers[lc].delete_edge(index, n);
+			if (result.size() >= M)
+				break;
+
+			// e is kept if it is closer to the element than to any neighbor kept before
+			VecView<const T> vec = padded_row<typename SearchDist::type>(m_data, e);
+			bool is_closer = std::all_of(result.begin(), result.end(), [&](index_t r) {
+				return dist_eq < calc_distance(vec, r);
+				});
+			if (is_closer)
+				result.push_back(e);
+			else if (m_keepPrunedConnections)
+				pruned.push_back(e);
 		}
+
+		for (size_t i = 0; i < pruned.size() && result.size() < M; i++)
+			result.push_back(pruned[i]);
+
+		return result;
 	}
 
 
+	// adds neighbors of the candidates at level lc to the candidates, keeps them sorted by distance to q
 	template <typename T, typename Dist>
-	void HNSW<T, Dist>::insert(index_t index)
+	void HNSW<T, Dist>::extend_candidates(VecView<const T> q, level_t lc, std::vector<DI>& candidates, utils::VisitedList& visited) const
 	{
-		level_t insert_level = get_random_level();
-
-		m_elementLevels[index] = insert_level;
+		visited.reset();
+		for (const auto& c : candidates)
+			visited.visit(c.second);
 
-		for (level_t lc = insert_level; lc >= 0; lc--)
+		IndexVector extension;
+		for (size_t i = 0, size = candidates.size(); i < size; i++)
 		{
-			auto& g = m_layers[lc];
-			g.insert_vertex(index);
+			std::lock_guard<utils::Spinlock> lock(m_linkLocks[candidates[i].second]);
+			for (const auto& e : m_graph.links(static_cast<HnswGraph::id_t>(candidates[i].second), lc))
+			{
+				if (visited.visit(e))
+					extension.push_back(e);
+			}
 		}
 
+		auto extension_with_distances = calc_distances(q, extension);
+		candidates.insert(candidates.end(), extension_with_distances.begin(), extension_with_distances.end());
+		std::stable_sort(candidates.begin(), candidates.end());
+	}
+
+
+	// adds link index -> link at level lc, if index has max links already, selects neighbors among its links and the new one
+	template <typename T, typename Dist>
+	void HNSW<T, Dist>::add_link(index_t index, level_t lc, index_t link)
+	{
+		const auto id = static_cast<HnswGraph::id_t>(index);
+		std::lock_guard<utils::Spinlock> lock(m_linkLocks[index]);
+		if (m_graph.add_link(id, lc, static_cast<HnswGraph::id_t>(link)))
+			return;
+
+		auto links = m_graph.links(id, lc);
+		IndexVector candidates(links.begin(), links.end());
+		candidates.push_back(link);
+		VecView<const T> vec = padded_row<typename SearchDist::type>(m_data, index);
+		auto candidates_with_distances = calc_distances(vec, candidates);
+		m_graph.set_links(id, lc, select_neighbors(candidates_with_distances, m_graph.max_links(lc)));
+	}
+
+
+	// inserts element with the level set already, may run concurrently with other insertions
+	template <typename T, typename Dist>
+	void HNSW<T, Dist>::insert(index_t index, QueryContext& context)
+	{
+		const level_t insert_level = m_graph.level(static_cast<HnswGraph::id_t>(index));
+
+		// element on a new top level holds the lock for the whole insertion, so that nobody starts from the new entry point before it is linked
+		std::unique_lock<std::mutex> entry_point_lock(m_entryPointMutex);
+		const level_t max_level = m_maxLevel;
+		index_t ep = m_entryPoint;
+		if (insert_level <= max_level)
+			entry_point_lock.unlock();
+
 		// first insertion on empty hnsw
-		if (m_maxLevel == -1)
+		if (max_level == -1)
 		{
 			m_maxLevel = insert_level;
 			m_entryPoint = index;
@@ -209,40 +605,53 @@ namespace anny
 		}
 
 		// insert here
-		VecView<T> q = m_data[index];
+		VecView<const T> q = padded_row<typename SearchDist::type>(m_data, index);
+		auto visited = m_visitedPool.get();
 
-		IndexVector ep = { m_entryPoint };
-		level_t lc = m_maxLevel;
+		level_t lc = max_level;
 		// greedy search for finding nearest entry point at curr max level 
 		for (; lc > insert_level; lc--)
 		{
-			auto search_res = search_layer(q, ep, /*ef*/ 1, lc);
-			ep = { search_res.front().second }; // because we take only 1 closest neighbor on each of these layers
+			search_layer</*LockLinks*/ true>(q, ep, /*ef*/ 1, lc, context, *visited);
+			ep = context.m_nearest.front().second; // because we take only 1 closest neighbor on each of these layers
 		}
-		// insert vertex and add edges to closest neighbors
-		for (lc = std::min(insert_level, m_maxLevel); lc >= 0; lc--)
+		// find closest neighbors at every level
+		const level_t top_level = std::min(insert_level, max_level);
+		std::vector<IndexVector> neighbors(top_level + 1);
+		for (lc = top_level; lc >= 0; lc--)
 		{
-			auto search_res = search_layer(q, ep, m_efConstruction, lc);
-			IndexVector neighbors = select_neighbors(search_res, m_M);
-
-			auto& g = m_layers[lc];
-			for (const auto& n : neighbors)
+			search_layer</*LockLinks*/ true>(q, ep, m_efConstruction, lc, context, *visited);
+			if (m_neighborSelection == NeighborSelection::HEURISTIC && m_extendCandidates)
+			{
+				std::vector<DI> candidates(context.m_nearest);
+				extend_candidates(q, lc, candidates, *visited);
+				neighbors[lc] = select_neighbors(candidates, m_M);
+			}
+			else
 			{
-				g.insert_edge(index, n);
+				neighbors[lc] = select_neighbors(context.m_nearest, m_M);
 			}
+			ep = context.m_nearest.front().second;  // the nearest element found is entry point at the next level
+		}
 
-			// cut edges
-			size_t curr_M = lc > 0 ? m_M : m_Mmax0;
-			for (const auto& n : neighbors)
+		/*
+			Links both ways, neighbors which have max links already select them again among their links and the new one.
+			Levels are linked bottom up: once concurrent searches reach the element at some level, its links are set
+			at all levels below, so they never descend into an element without links.
+		*/
+		for (lc = 0; lc <= top_level; lc++)
+		{
 			{
-				if (g.get_adj_vertices(n).size() > curr_M)
-				{
-					shrink_connections(n, lc, curr_M);
-				}
+				std::lock_guard<utils::Spinlock> lock(m_linkLocks[index]);
+				m_graph.set_links(static_cast<HnswGraph::id_t>(index), lc, neighbors[lc]);
+			}
+			for (const auto& n : neighbors[lc])
+			{
+				add_link(n, lc, index);
 			}
 		}
 		
-		if (insert_level > m_maxLevel)
+		if (insert_level > max_level)
 		{
 			m_maxLevel = insert_level;
 			m_entryPoint = index;
@@ -250,30 +659,169 @@ namespace anny
 	}
 
 
+	// greedy search from the entry point down to level 1, returns entry point for level 0
 	template <typename T, typename Dist>
-	IndexVector HNSW<T, Dist>::knn_search(VecView<T> q, size_t k)
+	index_t HNSW<T, Dist>::search_upper_layers(VecView<const T> q, QueryContext& context, utils::VisitedList& visited) const
 	{
-		IndexVector ep = { m_entryPoint };
-		level_t lc = m_maxLevel;
-		// greedy search until level 1 
-		for (; lc >= 1; lc--)
+		index_t ep = m_entryPoint;
+		for (level_t lc = m_maxLevel; lc >= 1; lc--)
 		{
-			auto search_res = search_layer(q, ep, /*ef*/ 1, lc);
-			ep = { search_res.front().second }; // because we take only 1 closest neighbor on each of these layers
+			search_layer</*LockLinks*/ false>(q, ep, /*ef*/ 1, lc, context, visited);
+			ep = context.m_nearest.front().second; // because we take only 1 closest neighbor on each of these layers
 		}
+		return ep;
+	}
+
+
+	// k nearest allowed elements to q are left in the beginning of context.m_nearest, returns their number
+	template <typename T, typename Dist>
+	template <typename Filter>
+	size_t HNSW<T, Dist>::search(VecView<const T> vec, size_t k, QueryContext& context, const Filter& filter) const
+	{
+		if (k == 0 || is_hnsw_empty())
+			return 0;
+
+		const auto q = pad_query<typename SearchDist::type>(vec, m_data, context.m_query);
+		constexpr bool FILTERED = !std::is_same_v<Filter, AllowAll>;
+		const size_t ef = std::max(m_efSearch, k);
+		if constexpr (FILTERED)
+		{
+			// graph search computes about ef * num_elements / num_allowed distances to collect ef allowed elements
+			const size_t num_allowed = estimate_num_allowed(filter);
+			if (1.0 * num_allowed * num_allowed <= 1.0 * ef * num_elements())
+				return search_exact(q, k, context, filter);
+		}
+
+		auto visited = m_visitedPool.get();  // one list for all layers, reset by search_layer
+		const index_t ep = search_upper_layers(q, context, *visited);
+
 		// search at level 0
-		auto search_res = search_layer(q, ep, m_efSearch, 0);
-		IndexVector result = select_neighbors(search_res, k, /*is_sorted*/ true);
+		auto is_alive = [this](index_t e) { return m_nodeStates[e] == NodeState::ALIVE; };
+		if constexpr (FILTERED)
+			search_layer</*LockLinks*/ false>(q, ep, ef, 0, context, *visited, [&](index_t e) { return is_alive(e) && is_allowed(filter, e); });
+		else if (m_numDeleted > 0)
+			search_layer</*LockLinks*/ false>(q, ep, ef, 0, context, *visited, is_alive);
+		else
+			search_layer</*LockLinks*/ false>(q, ep, ef, 0, context, *visited);
+		return std::min(k, context.m_nearest.size());
+	}
+
+
+	// exact search over all alive allowed elements, the result is left like by search()
+	template <typename T, typename Dist>
+	template <typename Filter>
+	size_t HNSW<T, Dist>::search_exact(VecView<const T> q, size_t k, QueryContext& context, const Filter& filter) const
+	{
+		auto& allowed = context.m_unvisited;
+		auto& distances = context.m_unvisitedDistances;
+		allowed.clear();
+		for (index_t index = 0; index < num_elements(); index++)
+		{
+			if (m_nodeStates[index] == NodeState::ALIVE && is_allowed(filter, index))
+				allowed.push_back(index);
+		}
+		distance_batch<typename SearchDist::type>(q, m_data, allowed, distances);
+
+		auto& nearest = context.m_nearest;
+		nearest.clear();
+		for (size_t i = 0; i < allowed.size(); i++)
+			nearest.push_back({ distances[i], allowed[i] });
+		const size_t count = std::min(k, nearest.size());
+		std::partial_sort(nearest.begin(), nearest.begin() + count, nearest.end());
+		return count;
+	}
+
+
+	template <typename T, typename Dist>
+	template <typename Filter>
+	bool HNSW<T, Dist>::is_allowed(const Filter& filter, index_t index) const
+	{
+		if constexpr (std::is_same_v<Filter, utils::Bitset>)
+			return filter.test(to_external(index));
+		else
+			return filter(to_external(index));
+	}
+
+
+	/*
+		Number of elements allowed by the filter: exact for a bitset, estimated on a sample for a predicate.
+		Sampled elements are spread by the golden ratio sequence, so periodic filters (every n-th element) are not aliased.
+	*/
+	template <typename T, typename Dist>
+	template <typename Filter>
+	size_t HNSW<T, Dist>::estimate_num_allowed(const Filter& filter) const
+	{
+		if constexpr (std::is_same_v<Filter, utils::Bitset>)
+		{
+			return filter.count();
+		}
+		else
+		{
+			const size_t num_sampled = std::min(num_elements(), FILTER_SAMPLE_SIZE);
+			size_t num_allowed = 0;
+			double position = 0.0;
+			for (size_t i = 0; i < num_sampled; i++)
+			{
+				position += 0.6180339887498949;
+				position -= (position >= 1.0) ? 1.0 : 0.0;
+				const auto index = (num_sampled == num_elements()) ? i : static_cast<index_t>(position * num_elements());
+				num_allowed += filter(index) ? 1 : 0;
+			}
+			return num_allowed * num_elements() / num_sampled;
+		}
+	}
+
+
+	template <typename T, typename Dist>
+	size_t HNSW<T, Dist>::knn_query_into(const T* query, size_t k, index_t* indices, T* distances, QueryContext& context) const
+	{
+		return knn_query_into(query, k, indices, distances, context, AllowAll{});
+	}
+
+
+	template <typename T, typename Dist>
+	template <typename Filter>
+	size_t HNSW<T, Dist>::knn_query_into(const T* query, size_t k, index_t* indices, T* distances, QueryContext& context, const Filter& filter) const
+	{
+		const size_t count = search(VecView<const T>(query, m_data.num_cols()), k, context, filter);
+		for (size_t i = 0; i < count; i++)
+		{
+			const auto& [dist, index] = context.m_nearest[i];
+			indices[i] = to_external(index);
+			if (distances)
+				distances[i] = SearchDist::to_distance(dist);
+		}
+		return count;
+	}
+
+
+	template <typename T, typename Dist>
+	typename HNSW<T, Dist>::KnnResult HNSW<T, Dist>::knn_search(VecView<const T> vec, size_t k) const
+	{
+		return search_result(vec, k, AllowAll{});
+	}
+
+
+	template <typename T, typename Dist>
+	template <typename Filter>
+	typename HNSW<T, Dist>::KnnResult HNSW<T, Dist>::search_result(VecView<const T> vec, size_t k, const Filter& filter) const
+	{
+		thread_local QueryContext context;  // scratch memory is reused by all queries of the thread
+
+		KnnResult result;
+		const size_t count = search(vec, k, context, filter);
+		result.reserve(count);
+		std::transform(context.m_nearest.begin(), context.m_nearest.begin() + count, std::back_inserter(result), [this](const DI& el) {
+			return std::make_pair(to_external(el.second), SearchDist::to_distance(el.first));
+			});
 		return result;
 	}
 
 
 	template <typename T, typename Dist>
-	void HNSW<T, Dist>::fit(const std::vector<std::vector<T>>& data)
+	void HNSW<T, Dist>::fit(DataMatrix&& data)
 	{
-		MatrixStorageVV<T> storage(data);
-		Matrix<T, MatrixStorageVV<T>> m(storage);
-		m_data = std::move(m);
+		m_data = std::move(data);
 		
 		IndexVector all_indices(m_data.num_rows());
 		std::iota(all_indices.begin(), all_indices.end(), 0);
@@ -281,67 +829,572 @@ namespace anny
 		// fit here
 		clear();
 			
-		m_elementLevels.resize(m_data.num_rows());
-		for (level_t l = 0; l < MAX_LAYERS; l++)
-			m_layers.push_back(anny::Graph<index_t>());
+		if (m_data.num_rows() > HnswGraph::MAX_NODES)
+			throw std::runtime_error("HNSW supports up to 2^32 - 1 elements");
+		m_graph.resize(m_data.num_rows());
+		m_linkLocks = std::vector<utils::Spinlock>(m_data.num_rows());
+		m_nodeStates.assign(m_data.num_rows(), NodeState::ALIVE);
+		m_visitedPool.set_num_elements(m_data.num_rows());
+
+		insert_elements(all_indices, /*show_progress*/ true);
+	}
 
+
+	template <typename T, typename Dist>
+	template <typename Storage>
+	IndexVector HNSW<T, Dist>::add_items(const Matrix<T, Storage>& items)
+	{
+		if (items.num_rows() == 0)
+			return {};
+		if (m_data.num_rows() > 0 && items.num_cols() != m_data.num_cols())
+			throw std::runtime_error("Items must have the same number of columns as data of the index");
+
+		const size_t num_reused = std::min(m_freeSlots.size(), items.num_rows());
+		const size_t first = m_data.num_rows();
+		const size_t num_elements = first + items.num_rows() - num_reused;
+		if (num_elements > HnswGraph::MAX_NODES)
+			throw std::runtime_error("HNSW supports up to 2^32 - 1 elements");
+
+		// also moves borrowed or shared data to own memory, as rows of free slots are overwritten
+		reserve(num_elements > m_data.capacity() ? std::max(num_elements, 2 * m_data.capacity()) : m_data.capacity());
+
+		IndexVector indices;
+		indices.reserve(items.num_rows());
+		for (size_t i = 0; i < num_reused; i++)
+		{
+			const index_t index = m_freeSlots.back();
+			m_freeSlots.pop_back();
+			auto row = m_data[index];
+			std::copy(items[i].begin(), items[i].end(), row.begin());
+			m_nodeStates[index] = NodeState::ALIVE;
+			m_numDeleted--;
+			indices.push_back(index);
+		}
+		for (size_t i = num_reused; i < items.num_rows(); i++)
 		{
-			anny::utils::ProgressBar pb(1000);
-			for (size_t index = 0; index < m_data.num_rows(); index++, pb.update())
+			indices.push_back(m_data.num_rows());
+			m_data.push_back(items[i]);
+			if (!m_externalIds.empty())
 			{
-				insert(index);
+				m_externalIds.push_back(indices.back());
+				m_internalIds.push_back(indices.back());
 			}
 		}
 
+		assert(m_linkLocks.size() >= num_elements);
+		m_graph.resize(num_elements);
+		m_nodeStates.resize(num_elements, NodeState::ALIVE);
+		m_visitedPool.set_num_elements(num_elements);
+
+		insert_elements(indices, /*show_progress*/ false);
+		std::transform(indices.begin(), indices.end(), indices.begin(), [this](index_t index) { return to_external(index); });
+		return indices;
 	}
 
 
 	template <typename T, typename Dist>
-	T HNSW<T, Dist>::calc_distance(VecView<T> vec, index_t index)
+	void HNSW<T, Dist>::save(const std::string& path) const
 	{
-		return this->m_dist_func(m_data[index], vec);
+		const size_t num_elements = m_data.num_rows();
+		const size_t cols = num_elements ? m_data.num_cols() : 0;
+		const size_t stride = MatrixStorageAligned<T>::padded_size(cols);
+
+		HnswFileHeader header{};
+		std::memcpy(header.magic, HnswFileHeader::MAGIC, sizeof(header.magic));
+		header.version = HnswFileHeader::VERSION;
+		header.elem_size = sizeof(T);
+		header.distance_id = static_cast<uint64_t>(detail::distance_id_v<Dist>());
+		header.M = m_M;
+		header.Mmax0 = m_Mmax0;
+		header.ef_construction = m_efConstruction;
+		header.ef_search = m_efSearch;
+		header.neighbor_selection = static_cast<uint8_t>(m_neighborSelection);
+		header.extend_candidates = m_extendCandidates;
+		header.keep_pruned_connections = m_keepPrunedConnections;
+		header.max_level = m_maxLevel;
+		header.entry_point = m_entryPoint;
+		header.num_elements = num_elements;
+		header.num_deleted = m_numDeleted;
+		header.cols = cols;
+		header.row_stride = stride;
+
+		const auto graph_arrays = m_graph.raw_arrays();
+		std::array<size_t, HnswFileHeader::NUM_SECTIONS> sizes;
+		for (size_t i = 0; i < HnswGraph::NUM_ARRAYS; i++)
+			sizes[i] = graph_arrays[i].size;
+		sizes[HnswFileHeader::NODE_STATES] = m_nodeStates.size() * sizeof(NodeState);
+		sizes[HnswFileHeader::DATA] = num_elements * stride * sizeof(T);
+		sizes[HnswFileHeader::EXTERNAL_IDS] = m_externalIds.size() * sizeof(uint64_t);
+
+		auto align = [](size_t offset) {
+			return (offset + HnswFileHeader::SECTION_ALIGNMENT - 1) / HnswFileHeader::SECTION_ALIGNMENT * HnswFileHeader::SECTION_ALIGNMENT;
+		};
+		size_t offset = sizeof(HnswFileHeader);
+		for (size_t i = 0; i < HnswFileHeader::NUM_SECTIONS; i++)
+		{
+			offset = align(offset);
+			header.sections[i] = { offset, sizes[i] };
+			offset += sizes[i];
+		}
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+			throw std::runtime_error("Failed to open HNSW file for writing: " + path);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		// zeros between sections
+		size_t written = sizeof(header);
+		auto pad_to = [&](size_t section) {
+			const char zeros[HnswFileHeader::SECTION_ALIGNMENT] = {};
+			out.write(zeros, header.sections[section].offset - written);
+			written = header.sections[section].offset + sizes[section];
+		};
+		for (size_t i = 0; i < HnswGraph::NUM_ARRAYS; i++)
+		{
+			pad_to(i);
+			out.write(static_cast<const char*>(graph_arrays[i].data), graph_arrays[i].size);
+		}
+		pad_to(HnswFileHeader::NODE_STATES);
+		out.write(reinterpret_cast<const char*>(m_nodeStates.data()), sizes[HnswFileHeader::NODE_STATES]);
+
+		pad_to(HnswFileHeader::DATA);
+		std::vector<T> row_buffer(stride, T{ 0 });
+		for (size_t i = 0; i < num_elements; i++)
+		{
+			auto row = m_data[i];
+			std::copy(row.begin(), row.end(), row_buffer.begin());
+			out.write(reinterpret_cast<const char*>(row_buffer.data()), stride * sizeof(T));
+		}
+
+		pad_to(HnswFileHeader::EXTERNAL_IDS);
+		const std::vector<uint64_t> external_ids(m_externalIds.begin(), m_externalIds.end());
+		out.write(reinterpret_cast<const char*>(external_ids.data()), sizes[HnswFileHeader::EXTERNAL_IDS]);
+		if (!out)
+			throw std::runtime_error("Failed to write HNSW file: " + path);
 	}
 
 
 	template <typename T, typename Dist>
-	std::vector<typename HNSW<T, Dist>::DI> HNSW<T, Dist>::calc_distances(VecView<T> vec, const IndexVector& indices)
+	void HNSW<T, Dist>::load(const std::string& path, MappedFile::Advice advice)
 	{
-		assert(m_data[0].is_same_size(vec));
+		auto file = std::make_shared<MappedFile>(path, MappedFile::Mode::COPY_ON_WRITE);  // repair() patches attached links in place
+		if (file->size() < sizeof(HnswFileHeader))
+			throw std::runtime_error("Bad HNSW file (too short): " + path);
+
+		HnswFileHeader header;
+		std::memcpy(&header, file->data(), sizeof(header));
+		const char* error = validate(header, file->size());
+		if (error)
+			throw std::runtime_error(std::string("Bad HNSW file (") + error + "): " + path);
+
+		auto section = [&](size_t i) {
+			return file->data() + header.sections[i].offset;
+		};
+		HnswGraph::RawArrays graph_arrays;
+		for (size_t i = 0; i < HnswGraph::NUM_ARRAYS; i++)
+			graph_arrays[i] = { section(i), header.sections[i].size };
+		HnswGraph graph;
+		graph.attach(header.Mmax0, header.M, graph_arrays, file);
+		if (graph.num_nodes() != header.num_elements)
+			throw std::runtime_error("Bad HNSW file (graph size mismatch): " + path);
+
+		auto ids = reinterpret_cast<const uint64_t*>(section(HnswFileHeader::EXTERNAL_IDS));
+		IndexVector external_ids(ids, ids + header.sections[HnswFileHeader::EXTERNAL_IDS].size / sizeof(uint64_t));
+		IndexVector internal_ids(external_ids.size(), UNDEFINED_INDEX);
+		for (index_t index = 0; index < external_ids.size(); index++)
+		{
+			if (external_ids[index] >= external_ids.size() || internal_ids[external_ids[index]] != UNDEFINED_INDEX)
+				throw std::runtime_error("Bad HNSW file (external ids are not a permutation): " + path);
+			internal_ids[external_ids[index]] = index;
+		}
 
-		std::vector<DI> distances;
+		file->advise(advice, 0, file->size());
 
-		for (const auto& index: indices)
+		// the file is fine, state of the index is replaced
+		clear();
+		m_M = header.M;
+		m_Mmax0 = header.Mmax0;
+		m_efConstruction = header.ef_construction;
+		m_efSearch = header.ef_search;
+		m_mL = 1.0 / log(1.0 * m_M);
+		m_neighborSelection = static_cast<NeighborSelection>(header.neighbor_selection);
+		m_extendCandidates = header.extend_candidates != 0;
+		m_keepPrunedConnections = header.keep_pruned_connections != 0;
+		m_maxLevel = header.max_level;
+		m_entryPoint = header.entry_point;
+
+		const size_t num_elements = header.num_elements;
+		auto data = reinterpret_cast<T*>(section(HnswFileHeader::DATA));
+		m_data = DataMatrix(MatrixStorageView<T>(file, data, num_elements, header.cols, header.row_stride));
+		m_graph = std::move(graph);
+		m_externalIds = std::move(external_ids);
+		m_internalIds = std::move(internal_ids);
+
+		auto states = reinterpret_cast<const NodeState*>(section(HnswFileHeader::NODE_STATES));
+		m_nodeStates.assign(states, states + num_elements);
+		m_numDeleted = header.num_deleted;
+		if (m_numDeleted > 0)
 		{
-			distances.push_back( { this->m_dist_func(m_data[index], vec), index } );
+			for (index_t index = num_elements; index-- > 0;)  // lower slots are reused first
+			{
+				if (m_nodeStates[index] == NodeState::FREE)
+					m_freeSlots.push_back(index);
+			}
 		}
 
-		std::stable_sort(distances.begin(), distances.end());
+		m_linkLocks = std::vector<utils::Spinlock>(num_elements);
+		m_visitedPool.set_num_elements(num_elements);
+	}
 
-		return distances;
+
+	template <typename T, typename Dist>
+	const char* HNSW<T, Dist>::validate(const HnswFileHeader& header, size_t file_size)
+	{
+		if (std::memcmp(header.magic, HnswFileHeader::MAGIC, sizeof(header.magic)) != 0)
+			return "wrong magic";
+		if (header.version == 0 || header.version > HnswFileHeader::VERSION)
+			return "unsupported version";
+		if (header.elem_size != sizeof(T))
+			return "element type size mismatch";
+		if (header.distance_id != static_cast<uint64_t>(detail::distance_id_v<Dist>()))
+			return "distance mismatch";
+		if (header.M < 2 || header.Mmax0 < header.M)
+			return "bad M";
+		if (header.neighbor_selection > static_cast<uint8_t>(NeighborSelection::HEURISTIC))
+			return "bad neighbor selection";
+		if (header.max_level < -1 || header.max_level > MAX_LAYERS || (header.max_level >= 0 && header.entry_point >= header.num_elements))
+			return "bad entry point";
+		if (header.num_elements > HnswGraph::MAX_NODES || header.num_deleted > header.num_elements)
+			return "bad number of elements";
+		if (header.row_stride < header.cols || (header.num_elements > 0 && header.cols == 0))
+			return "bad row size";
+		for (const auto& section : header.sections)
+		{
+			if (section.offset % HnswFileHeader::SECTION_ALIGNMENT != 0 || section.offset > file_size || section.size > file_size - section.offset)
+				return "file is truncated";
+		}
+		if (header.sections[HnswFileHeader::NODE_STATES].size != header.num_elements * sizeof(NodeState))
+			return "bad states size";
+		if (header.num_elements > 0 && header.row_stride > header.sections[HnswFileHeader::DATA].size / sizeof(T) / header.num_elements)
+			return "bad data size";
+		const size_t ids_size = header.sections[HnswFileHeader::EXTERNAL_IDS].size;
+		if (ids_size != 0 && ids_size != header.num_elements * sizeof(uint64_t))
+			return "bad external ids size";
+		return nullptr;
 	}
 
 
 	template <typename T, typename Dist>
-	IndexVector HNSW<T, Dist>::knn_query(const std::vector<T>& vec, size_t k)
+	void HNSW<T, Dist>::reserve(size_t capacity)
 	{
-		IndexVector result;
-		if (k == 0)
-			return result;
+		m_data.reserve(capacity);
+		m_graph.reserve(capacity);
+		if (m_linkLocks.size() < capacity)
+		{
+			m_linkLocks = std::vector<utils::Spinlock>(capacity);  // no lock is held between builds, so new ones replace them
+		}
+	}
 
-		const auto N = m_data.num_rows();
-		k = (k > N) ? N : k;
 
-		Vec<T> query(vec);
+	template <typename T, typename Dist>
+	void HNSW<T, Dist>::mark_deleted(index_t index)
+	{
+		if (index >= m_data.num_rows())
+			throw std::runtime_error("Index is out of range");
+		index = to_internal(index);
+		if (m_nodeStates[index] != NodeState::ALIVE)
+			return;
+		m_nodeStates[index] = NodeState::DELETED;
+		m_numDeleted++;
+	}
+
 
-		result = knn_search(query.view(), k);
+	template <typename T, typename Dist>
+	void HNSW<T, Dist>::repair()
+	{
+		auto is_deleted_node = [this](index_t e) { return m_nodeStates[e] == NodeState::DELETED; };
+		IndexVector deleted;
+		for (index_t index = 0; index < m_data.num_rows(); index++)
+		{
+			if (is_deleted_node(index))
+				deleted.push_back(index);
+		}
+		if (deleted.empty())
+			return;
 
-		return result;
+		// alive elements linked to deleted ones select neighbors again among their alive links
+		// and alive elements reachable from them through deleted ones
+		auto visited = m_visitedPool.get();
+		IndexVector candidates;
+		IndexVector stack;
+		for (index_t index = 0; index < m_data.num_rows(); index++)
+		{
+			if (m_nodeStates[index] != NodeState::ALIVE)
+				continue;
+			const auto id = static_cast<HnswGraph::id_t>(index);
+			for (level_t lc = 0; lc <= m_graph.level(id); lc++)
+			{
+				auto links = m_graph.links(id, lc);
+				if (std::none_of(links.begin(), links.end(), is_deleted_node))
+					continue;
+
+				visited->reset();
+				visited->visit(index);
+				candidates.clear();
+				stack.assign(links.begin(), links.end());
+				while (!stack.empty())
+				{
+					const index_t e = stack.back();
+					stack.pop_back();
+					if (!visited->visit(e))
+						continue;
+					if (!is_deleted_node(e))
+					{
+						candidates.push_back(e);
+						continue;
+					}
+					for (const auto& n : m_graph.links(static_cast<HnswGraph::id_t>(e), lc))
+						stack.push_back(n);
+				}
+
+				VecView<const T> vec = std::as_const(m_data)[index];
+				m_graph.set_links(id, lc, select_neighbors(calc_distances(vec, candidates), m_graph.max_links(lc)));
+			}
+		}
+
+		// deleted elements are not reachable anymore, their slots wait for reuse with the same levels
+		for (const auto& index : deleted)
+		{
+			const auto id = static_cast<HnswGraph::id_t>(index);
+			for (level_t lc = 0; lc <= m_graph.level(id); lc++)
+				m_graph.set_links(id, lc, IndexVector{});
+			m_nodeStates[index] = NodeState::FREE;
+			m_freeSlots.push_back(index);
+		}
+		std::sort(m_freeSlots.begin(), m_freeSlots.end(), std::greater<index_t>());  // lower slots are reused first
+
+		// new entry point is an alive element with the highest level
+		if (m_nodeStates[m_entryPoint] != NodeState::ALIVE)
+		{
+			m_maxLevel = -1;
+			m_entryPoint = 0;
+			for (index_t index = 0; index < m_data.num_rows(); index++)
+			{
+				const level_t level = m_graph.level(static_cast<HnswGraph::id_t>(index));
+				if (m_nodeStates[index] == NodeState::ALIVE && level > m_maxLevel)
+				{
+					m_maxLevel = level;
+					m_entryPoint = index;
+				}
+			}
+		}
 	}
 
+
+	// permutes rows, links and states of elements into breadth-first order of level 0 links, external <-> internal id maps keep indices seen by users
+	template <typename T, typename Dist>
+	void HNSW<T, Dist>::reorder()
+	{
+		const size_t num_elements = m_data.num_rows();
+		if (num_elements == 0)
+			return;
+
+		const auto order = bfs_order<index_t>(num_elements, m_entryPoint, [this](index_t index) {
+			return m_graph.links(static_cast<HnswGraph::id_t>(index), 0);
+			});
+		IndexVector new_indices(num_elements);
+		for (index_t index = 0; index < num_elements; index++)
+			new_indices[order[index]] = index;
+
+		HnswGraph graph(m_Mmax0, m_M);
+		graph.resize(num_elements);
+		DataMatrix data(MatrixStorageView<T>(num_elements, m_data.num_cols()));
+		std::vector<NodeState> node_states(num_elements);
+		IndexVector external_ids(num_elements);
+		IndexVector links;
+		for (index_t index = 0; index < num_elements; index++)
+		{
+			const auto old_id = static_cast<HnswGraph::id_t>(order[index]);
+			const auto id = static_cast<HnswGraph::id_t>(index);
+			graph.set_level(id, m_graph.level(old_id));
+			for (level_t lc = 0; lc <= m_graph.level(old_id); lc++)
+			{
+				links.clear();
+				for (const auto& e : m_graph.links(old_id, lc))
+					links.push_back(new_indices[e]);
+				graph.set_links(id, lc, links);
+			}
+
+			auto row = std::as_const(m_data)[old_id];
+			std::copy(row.begin(), row.end(), data[index].begin());
+			node_states[index] = m_nodeStates[old_id];
+			external_ids[index] = to_external(old_id);
+		}
+
+		m_graph = std::move(graph);
+		m_data = std::move(data);
+		m_nodeStates = std::move(node_states);
+		for (auto& index : m_freeSlots)
+			index = new_indices[index];
+		std::sort(m_freeSlots.begin(), m_freeSlots.end(), std::greater<index_t>());  // lower slots are reused first
+		m_entryPoint = new_indices[m_entryPoint];
+		m_internalIds.resize(num_elements);
+		for (index_t index = 0; index < num_elements; index++)
+			m_internalIds[external_ids[index]] = index;
+		m_externalIds = std::move(external_ids);
+	}
+
+
+	// inserts elements which are in the data and the graph already, but have no links yet (and levels, if they are new)
+	template <typename T, typename Dist>
+	void HNSW<T, Dist>::insert_elements(const IndexVector& indices, bool show_progress)
+	{
+		// levels are drawn in the order of elements, independent of the number of threads
+		for (const auto& index : indices)
+		{
+			const auto id = static_cast<HnswGraph::id_t>(index);
+			if (m_graph.level(id) == -1)
+				m_graph.set_level(id, get_random_level());
+		}
+
+		const size_t num_threads = (m_numBuildThreads == 0) ? utils::default_num_threads() : m_numBuildThreads;
+		if (num_threads == 1 || indices.size() <= 1)
+		{
+			QueryContext context;
+			std::optional<anny::utils::ProgressBar> pb;
+			if (show_progress)
+				pb.emplace(1000);
+			for (const auto& index : indices)
+			{
+				insert(index, context);
+				if (pb)
+					pb->update();
+			}
+		}
+		else
+		{
+			// threads take elements one by one from the shared counter, so elements are inserted almost in order, as by one thread
+			std::atomic<size_t> next{ 0 };
+			utils::ThreadPool pool(std::min(num_threads, indices.size()));
+			std::vector<std::future<void>> futures;
+			for (size_t t = 0; t < pool.num_threads(); t++)
+			{
+				futures.push_back(pool.submit([this, &next, &indices] {
+					QueryContext context;
+					for (size_t i = next++; i < indices.size(); i = next++)
+					{
+						insert(indices[i], context);
+					}
+				}));
+			}
+			for (auto& f : futures)
+				f.wait();
+			for (auto& f : futures)
+				f.get();
+		}
+	}
+
+
+	template <typename T, typename Dist>
+	T HNSW<T, Dist>::calc_distance(VecView<const T> vec, index_t index) const
+	{
+		return distance_to_row<typename SearchDist::type>(vec, m_data, index);
+	}
+
+
 	template <typename T, typename Dist>
-	IndexVector HNSW<T, Dist>::radius_query(const std::vector<T>& vec, T radius)
+	std::vector<typename HNSW<T, Dist>::DI> HNSW<T, Dist>::calc_distances(VecView<const T> vec, const IndexVector& indices) const
 	{
-		throw std::runtime_error("Not implemented");
+		std::vector<T> batch;
+		distance_batch<typename SearchDist::type>(vec, m_data, indices, batch);
+
+		std::vector<DI> distances(indices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			distances[i] = { batch[i], indices[i] };
+		}
+
+		std::stable_sort(distances.begin(), distances.end());
+
+		return distances;
+	}
+
+
+	/*
+		Range search: level 0 is searched like for knn from the entry point found on upper levels, ef doubles while
+		more than half of the ef nearest elements found are within radius, so the search reaches beyond the border of the ball.
+		Then breadth-first search from the found elements within radius expands all elements within radius
+		reachable from them, so elements missed by the beam of the search are found too.
+	*/
+	template <typename T, typename Dist>
+	typename HNSW<T, Dist>::KnnResult HNSW<T, Dist>::radius_search(VecView<const T> vec, T radius) const
+	{
+		thread_local QueryContext context;  // scratch memory is reused by all queries of the thread
+
+		KnnResult result;
+		if (is_hnsw_empty())
+			return result;
+
+		const T search_radius = SearchDist::from_distance(radius);
+		auto is_alive = [this](index_t e) { return m_nodeStates[e] == NodeState::ALIVE; };
+		auto visited = m_visitedPool.get();
+		const auto q = pad_query<typename SearchDist::type>(vec, m_data, context.m_query);
+		const index_t ep = search_upper_layers(q, context, *visited);
+
+		size_t ef = std::max<size_t>(m_efSearch, 1);
+		for (;;)
+		{
+			search_layer</*LockLinks*/ false>(q, ep, ef, 0, context, *visited, is_alive);
+			const auto& w = context.m_nearest;
+			const size_t num_within = std::upper_bound(w.begin(), w.end(), DI{ search_radius, UNDEFINED_INDEX }) - w.begin();
+			if (w.size() < ef || 2 * num_within <= ef || ef >= num_elements())
+				break;
+			ef = std::min(2 * ef, num_elements());
+		}
+
+		// found elements within radius are the seeds of the breadth-first search
+		std::vector<DI> found;
+		auto& queue = context.m_candidates;
+		queue.clear();
+		visited->reset();
+		for (const auto& el : context.m_nearest)
+		{
+			if (el.first > search_radius)
+				break;
+			visited->visit(el.second);
+			found.push_back(el);
+			queue.push_back(el);
+		}
+
+		// deleted elements within radius are expanded, but not returned
+		auto& unvisited = context.m_unvisited;
+		auto& unvisited_distances = context.m_unvisitedDistances;
+		for (size_t head = 0; head < queue.size(); head++)
+		{
+			unvisited.clear();
+			for (const auto& e : m_graph.links(static_cast<HnswGraph::id_t>(queue[head].second), 0))
+			{
+				if (visited->visit(e))
+					unvisited.push_back(e);
+			}
+			distance_batch<typename SearchDist::type>(q, m_data, unvisited, unvisited_distances);
+
+			for (size_t i = 0; i < unvisited.size(); i++)
+			{
+				if (unvisited_distances[i] > search_radius)
+					continue;
+				queue.push_back({ unvisited_distances[i], unvisited[i] });
+				if (is_alive(unvisited[i]))
+					found.push_back(queue.back());
+			}
+		}
+
+		std::sort(found.begin(), found.end());
+		result.reserve(found.size());
+		std::transform(found.begin(), found.end(), std::back_inserter(result), [this](const DI& el) {
+			return std::make_pair(to_external(el.second), SearchDist::to_distance(el.first));
+			});
+		return result;
 	}
 
 }
\ No newline at end of file
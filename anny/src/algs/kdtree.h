@@ -7,6 +7,7 @@
 #include "../core/vec_view.h"
 #include "../core/matrix.h"
 #include "../core/distance.h"
+#include "../core/mips_transform.h"
 #include "../utils/utils_defs.h"
 
 
@@ -23,11 +24,23 @@ namespace anny
 
 		~KDTree() override {}
 
-		void fit(const std::vector<std::vector<T>>& data) override;
-		IndexVector knn_query(const std::vector<T>& vec, size_t k) override;
-		IndexVector radius_query(const std::vector<T>& vec, T radius) override;
+		using typename IKnnAlgorithm<T>::DataMatrix;
+		using IKnnAlgorithm<T>::fit;
+
+		void fit(DataMatrix&& data) override;
+
+	protected:
+		using typename IKnnAlgorithm<T>::KnnResult;
+
+		KnnResult knn_search(VecView<const T> query, size_t k) const override;
+		KnnResult radius_search(VecView<const T> query, T radius) const override;
 	
 	private:
+		// MIPS is reduced to L2 search over augmented data, so splitting and pruning stay correct (see MipsTransform)
+		static constexpr bool IS_MIPS = std::is_same_v<Dist, anny::InnerProductDistance>;
+		using MetricDist = std::conditional_t<IS_MIPS, anny::L2Distance, Dist>;
+		using SearchDist = SearchDistance<MetricDist>;
+
 		struct Node;
 		using NodePtr = std::unique_ptr<Node>;
 
@@ -73,7 +86,7 @@ namespace anny
 		public:
 			using PQ = anny::utils::UniqueFixedSizePriorityQueue<std::pair<T, index_t>>;
 
-			KnnQueryNodeVisitor(KDTree<T, Dist>* tree, VecView<T> vec, size_t k)
+			KnnQueryNodeVisitor(const KDTree<T, Dist>* tree, VecView<T> vec, size_t k)
 				: m_candidates(anny::utils::FixedSizePriorityQueue<std::pair<T, index_t>>{ k })
 				, m_tree(tree)
 				, m_vec(vec)
@@ -103,7 +116,9 @@ namespace anny
 
 			T get_worst_distance() const override
 			{
-				return (!m_candidates.empty()) ? m_candidates.top().first : std::numeric_limits<T>::infinity();
+				if (!m_candidates.empty())
+					return m_candidates.top().first;
+				return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
 			}
 
 			std::vector<std::pair<T, index_t>> get_result() const override
@@ -114,7 +129,7 @@ namespace anny
 
 		private:
 			PQ m_candidates;
-			KDTree<T, Dist>* m_tree;
+			const KDTree<T, Dist>* m_tree;
 			VecView<T> m_vec;
 			size_t m_k;
 		};
@@ -125,11 +140,11 @@ namespace anny
 		public:
 			using PQ = anny::utils::UniquePriorityQueue<std::pair<T, index_t>>;
 
-			RadiusQueryNodeVisitor(KDTree<T, Dist>* tree, VecView<T> vec, T radius)
+			RadiusQueryNodeVisitor(const KDTree<T, Dist>* tree, VecView<T> vec, T search_radius)
 				: m_candidates(std::priority_queue<std::pair<T, index_t>>{})
 				, m_tree(tree)
 				, m_vec(vec)
-				, m_radius(radius)
+				, m_radius(search_radius)
 			{
 				assert(m_radius > 0.0);
 			}
@@ -169,23 +184,24 @@ namespace anny
 
 		private:
 			PQ m_candidates;
-			KDTree<T, Dist>* m_tree;
+			const KDTree<T, Dist>* m_tree;
 			VecView<T> m_vec;
-			T m_radius;
+			T m_radius;  // in search space
 		};
 
 
 		SplitResult split(const IndexVector& indices, size_t dim);
 		NodePtr build_kdtree(size_t dim, size_t leaf_size, const IndexVector& indices);
-		T calc_distance(VecView<T> vec, index_t index);
-		std::vector<std::pair<T, index_t>> calc_distances(VecView<T> vec, const IndexVector& indices);
-		void traverse_kdtree(KDTree<T, Dist>::Node* node, VecView<T> vec, size_t dim, NodeVisitor& visitor);
+		T calc_distance(VecView<T> vec, index_t index) const;
+		T to_index_distance(T search_distance, T query_norm_squared) const;
+		std::vector<std::pair<T, index_t>> calc_distances(VecView<T> vec, const IndexVector& indices) const;
+		void traverse_kdtree(KDTree<T, Dist>::Node* node, VecView<T> vec, size_t dim, NodeVisitor& visitor) const;
 
 	private:
-		Matrix<T, MatrixStorageVV<T>> m_data;
+		DataMatrix m_data;
 		NodePtr m_tree;
 		size_t m_leaf_size;
-		Dist m_dist_func;
+		MipsTransform<T> m_mips;
 	};
 
 
@@ -243,11 +259,14 @@ namespace anny
 
 
 	template <typename T, typename Dist>
-	void KDTree<T, Dist>::fit(const std::vector<std::vector<T>>& data)
+	void KDTree<T, Dist>::fit(DataMatrix&& data)
 	{
-		MatrixStorageVV<T> storage(data);
-		Matrix<T, MatrixStorageVV<T>> m(storage);
-		m_data = std::move(m);
+		m_data = std::move(data);
+
+		if constexpr (IS_MIPS)
+		{
+			m_data = m_mips.fit_transform(m_data);
+		}
 		
 		IndexVector all_indices(m_data.num_rows());
 		std::iota(all_indices.begin(), all_indices.end(), 0);
@@ -256,22 +275,24 @@ namespace anny
 
 
 	template <typename T, typename Dist>
-	T KDTree<T, Dist>::calc_distance(VecView<T> vec, index_t index)
+	T KDTree<T, Dist>::calc_distance(VecView<T> vec, index_t index) const
 	{
-		return this->m_dist_func(m_data[index], vec);
+		return distance_to_row<typename SearchDist::type>(vec, m_data, index);
 	}
 
 
 	template <typename T, typename Dist>
-	std::vector<std::pair<T, index_t>> KDTree<T, Dist>::calc_distances(VecView<T> vec, const IndexVector& indices)
+	std::vector<std::pair<T, index_t>> KDTree<T, Dist>::calc_distances(VecView<T> vec, const IndexVector& indices) const
 	{
-		assert(m_data[0].is_same_size(vec));
+		assert(m_data.num_cols() == vec.size());
 
-		std::vector<std::pair<T, index_t>> distances;
+		std::vector<T> batch;
+		distance_batch<typename SearchDist::type>(vec, m_data, indices, batch);
 
-		for (const auto& index: indices)
+		std::vector<std::pair<T, index_t>> distances(indices.size());
+		for (size_t i = 0; i < indices.size(); i++)
 		{
-			distances.push_back( { this->m_dist_func(m_data[index], vec), index } );
+			distances[i] = { batch[i], indices[i] };
 		}
 
 		std::stable_sort(distances.begin(), distances.end());
@@ -281,7 +302,7 @@ namespace anny
 
 
 	template <typename T, typename Dist>
-	void KDTree<T, Dist>::traverse_kdtree(KDTree<T, Dist>::Node* node, VecView<T> vec, size_t dim, NodeVisitor& visitor)
+	void KDTree<T, Dist>::traverse_kdtree(KDTree<T, Dist>::Node* node, VecView<T> vec, size_t dim, NodeVisitor& visitor) const
 	{
 		if (!node)
 			return;
@@ -311,8 +332,9 @@ namespace anny
 			traverse_kdtree(good_branch, vec, dim + 1, visitor);
 
 			// shall we check the opposite branch for possible neighbors?
-			auto distance_to_border = abs(vec[dim] - node->split);  // attention here - consistency with L2-distance metric is needed!!!
-			auto worst_curr_distance = visitor.get_worst_distance();
+			auto distance_to_border = BorderDistance<MetricDist>::lower_bound(vec[dim], node->split);
+			auto worst_curr_distance = visitor.get_worst_distance();  // in search space
+			distance_to_border = SearchDist::from_distance(distance_to_border);
 			if (distance_to_border < worst_curr_distance)
 			{
 				traverse_kdtree(opposite_branch, vec, dim + 1, visitor);
@@ -321,39 +343,68 @@ namespace anny
 	}
 
 
+	// converts distance from search space back to distance of the index
 	template <typename T, typename Dist>
-	IndexVector KDTree<T, Dist>::knn_query(const std::vector<T>& vec, size_t k)
+	T KDTree<T, Dist>::to_index_distance(T search_distance, T query_norm_squared) const
 	{
-		IndexVector result;
+		if constexpr (IS_MIPS)
+			return m_mips.from_l2_squared(search_distance, query_norm_squared);
+		else
+			return SearchDist::to_distance(search_distance);
+	}
+
+
+	template <typename T, typename Dist>
+	typename KDTree<T, Dist>::KnnResult KDTree<T, Dist>::knn_search(VecView<const T> vec, size_t k) const
+	{
+		KnnResult result;
 		if (k == 0)
 			return result;
 
 		const auto N = m_data.num_rows();
 		k = (k > N) ? N : k;
 
-		Vec<T> query(vec);
+		Vec<T> query = IS_MIPS ? m_mips.transform_query(vec) : Vec<T>(vec);
 		
 		KnnQueryNodeVisitor visitor(this, query.view(), k);
 
 		traverse_kdtree(m_tree.get(), query.view(), 0, visitor);
 		auto candidates_vec = visitor.get_result();
-		std::transform(candidates_vec.begin(), candidates_vec.end(), std::back_inserter(result), [](auto el) { return el.second; });
+		const T query_norm_squared = IS_MIPS ? l2_norm_squared(query.view()) : T{ 0 };
+		std::transform(candidates_vec.begin(), candidates_vec.end(), std::back_inserter(result), [this, query_norm_squared](auto el) {
+			return std::make_pair(el.second, to_index_distance(el.first, query_norm_squared));
+			});
 
 		return result;
 	}
 
 	template <typename T, typename Dist>
-	IndexVector KDTree<T, Dist>::radius_query(const std::vector<T>& vec, T radius)
+	typename KDTree<T, Dist>::KnnResult KDTree<T, Dist>::radius_search(VecView<const T> vec, T radius) const
 	{
-		IndexVector result;
+		KnnResult result;
 
-		Vec<T> query(vec);
+		Vec<T> query = IS_MIPS ? m_mips.transform_query(vec) : Vec<T>(vec);
+
+		T search_radius{};
+		if constexpr (IS_MIPS)
+		{
+			search_radius = m_mips.to_l2_squared(radius, l2_norm_squared(query.view()));
+			if (search_radius <= 0)
+				return result;  // no inner product can be that big
+		}
+		else
+		{
+			search_radius = SearchDist::from_distance(radius);
+		}
 
-		RadiusQueryNodeVisitor visitor(this, query.view(), radius);
+		RadiusQueryNodeVisitor visitor(this, query.view(), search_radius);
 
 		traverse_kdtree(m_tree.get(), query.view(), 0, visitor);
 		auto candidates_vec = visitor.get_result();
-		std::transform(candidates_vec.begin(), candidates_vec.end(), std::back_inserter(result), [](auto el) { return el.second; });
+		const T query_norm_squared = IS_MIPS ? l2_norm_squared(query.view()) : T{ 0 };
+		std::transform(candidates_vec.begin(), candidates_vec.end(), std::back_inserter(result), [this, query_norm_squared](auto el) {
+			return std::make_pair(el.second, to_index_distance(el.first, query_norm_squared));
+			});
 
 		return result;
 
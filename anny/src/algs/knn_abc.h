@@ -1,6 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
+#include <utility>
 #include <vector>
+#include "../core/vec_view.h"
+#include "../core/matrix.h"
+#include "../utils/thread_pool.h"
 
 namespace anny
 {
@@ -10,15 +16,142 @@ namespace anny
 	inline constexpr index_t UNDEFINED_INDEX = std::numeric_limits<size_t>::max();
 
 
+	/*
+		Result of a batch of knn queries: for every query k neighbors, nearest first, in flat row-major arrays
+		(neighbors of query i are at positions [i * k, (i + 1) * k)).
+		If fewer than k neighbors are found (k is bigger than the dataset, or approximate search returned fewer),
+		the rest of the row is filled with UNDEFINED_INDEX and the max distance.
+	*/
+	template <typename T>
+	struct KnnBatchResult
+	{
+		size_t num_queries{ 0 };
+		size_t k{ 0 };
+		IndexVector indices;
+		std::vector<T> distances;
+
+		index_t index(size_t query, size_t j) const { return indices[query * k + j]; }
+		T distance(size_t query, size_t j) const { return distances[query * k + j]; }
+	};
+
+
+	/*
+		Interface of all knn indices.
+		Query methods are const and keep all scratch state per call, so one built index can be shared
+		by any number of threads without locks. fit() and setters must not run concurrently with queries.
+	*/
 	template <typename T>
 	class IKnnAlgorithm
 	{
 	public:
+		using DataMatrix = Matrix<T, MatrixStorageView<T>>;
+		using KnnResult = std::vector<std::pair<index_t, T>>;  // neighbors with distances (same as Dist of the index gives), nearest first
+
 		virtual ~IKnnAlgorithm() {}
 
-		virtual void fit(const std::vector<std::vector<T>>& data) = 0;
-		virtual IndexVector knn_query(const std::vector<T>& vec, size_t k) = 0;
-		virtual IndexVector radius_query(const std::vector<T>& vec, T radius) = 0;	
+		// builds index over the data, which is adopted or referenced by the index without copying
+		virtual void fit(DataMatrix&& data) = 0;
+
+		// copies data into own aligned storage
+		void fit(const std::vector<std::vector<T>>& data)
+		{
+			fit(DataMatrix(MatrixStorageView<T>(MatrixStorageAligned<T>(data))));
+		}
+
+		// adopts memory of the matrix (contiguous, aligned or memory-mapped storage), no copy
+		template <typename Storage>
+		void fit(Matrix<T, Storage>&& data)
+		{
+			fit(DataMatrix(MatrixStorageView<T>(data.release())));
+		}
+
+		/*
+			References caller memory: rows x cols elements, row-major, rows are stride elements apart (0 - packed rows).
+			Elements between cols and stride are never read, so data may be a column range of a wider array.
+			The memory must stay alive and unchanged while the index is used. Indices which transform
+			data (cosine normalization, MIPS) make their own transformed copy.
+		*/
+		void fit(const T* data, size_t rows, size_t cols, size_t stride = 0)
+		{
+			fit(DataMatrix(MatrixStorageView<T>(data, rows, cols, stride)));
+		}
+
+		IndexVector knn_query(const std::vector<T>& vec, size_t k) const
+		{
+			return indices_of(knn_query_with_distances(vec, k));
+		}
+
+		// the same neighbors as knn_query gives, with distances computed during the search
+		KnnResult knn_query_with_distances(const std::vector<T>& vec, size_t k) const
+		{
+			return knn_search(VecView<const T>(vec.data(), vec.size()), k);
+		}
+
+		IndexVector radius_query(const std::vector<T>& vec, T radius) const
+		{
+			return indices_of(radius_query_with_distances(vec, radius));
+		}
+
+		// the same neighbors as radius_query gives, with distances computed during the search
+		KnnResult radius_query_with_distances(const std::vector<T>& vec, T radius) const
+		{
+			return radius_search(VecView<const T>(vec.data(), vec.size()), radius);
+		}
+
+		/*
+			knn queries for every row of queries. Queries are split between num_threads threads
+			(0 - use all hardware threads), each thread runs its contiguous part of queries one by one.
+		*/
+		template <typename Storage>
+		KnnBatchResult<T> knn_query_batch(const Matrix<T, Storage>& queries, size_t k, size_t num_threads = 0) const
+		{
+			KnnBatchResult<T> result;
+			result.num_queries = queries.num_rows();
+			result.k = k;
+			result.indices.assign(result.num_queries * k, UNDEFINED_INDEX);
+			result.distances.assign(result.num_queries * k, std::numeric_limits<T>::max());
+			if (k == 0)
+				return result;
+
+			auto process_queries = [&](size_t first, size_t last) {
+				for (size_t i = first; i < last; i++)
+				{
+					auto neighbors = knn_search(queries[i], k);
+					for (size_t j = 0; j < neighbors.size(); j++)
+					{
+						result.indices[i * k + j] = neighbors[j].first;
+						result.distances[i * k + j] = neighbors[j].second;
+					}
+				}
+			};
+
+			num_threads = (num_threads == 0) ? utils::default_num_threads() : num_threads;
+			if (num_threads == 1)
+			{
+				process_queries(0, result.num_queries);
+			}
+			else
+			{
+				utils::ThreadPool pool(num_threads);
+				pool.parallel_for(0, result.num_queries, process_queries);
+			}
+			return result;
+		}
+
+	protected:
+		// k nearest neighbors of query, nearest first
+		virtual KnnResult knn_search(VecView<const T> query, size_t k) const = 0;
+
+		// all neighbors within radius from query, nearest first
+		virtual KnnResult radius_search(VecView<const T> query, T radius) const = 0;
+
+		static IndexVector indices_of(const KnnResult& neighbors)
+		{
+			IndexVector result;
+			result.reserve(neighbors.size());
+			std::transform(neighbors.begin(), neighbors.end(), std::back_inserter(result), [](const auto& el) { return el.first; });
+			return result;
+		}
 	};
 
 }
\ No newline at end of file
@@ -19,31 +19,37 @@ namespace anny
 
 		~VanillaKnn() override {}
 
-		void fit(const std::vector<std::vector<T>>& data) override;
-		IndexVector knn_query(const std::vector<T>& vec, size_t k) override;
-		IndexVector radius_query(const std::vector<T>& vec, T radius) override;
+		using typename IKnnAlgorithm<T>::DataMatrix;
+		using IKnnAlgorithm<T>::fit;
+
+		void fit(DataMatrix&& data) override;
+
+	protected:
+		using typename IKnnAlgorithm<T>::KnnResult;
+
+		KnnResult knn_search(VecView<const T> query, size_t k) const override;
+		KnnResult radius_search(VecView<const T> query, T radius) const override;
 	
 	private:
-		std::vector<std::pair<index_t, T>> calc_distances(VecView<T> vec);
+		using SearchDist = SearchDistance<Dist>;
+
+		std::vector<std::pair<index_t, T>> calc_distances(VecView<T> vec) const;
 
 	private:
-		Matrix<T, MatrixStorageVV<T>> m_data;
-		Dist m_dist_func;
+		DataMatrix m_data;
 	};
 
 
 	template <typename T, typename Dist>
-	void VanillaKnn<T, Dist>::fit(const std::vector<std::vector<T>>& data)
+	void VanillaKnn<T, Dist>::fit(DataMatrix&& data)
 	{
-		MatrixStorageVV<T> storage(data);
-		Matrix<T, MatrixStorageVV<T>> m(storage);
-		m_data = std::move(m);
+		m_data = std::move(data);
 	}
 
 	template <typename T, typename Dist>
-	IndexVector VanillaKnn<T, Dist>::knn_query(const std::vector<T>& vec, size_t k)
+	typename VanillaKnn<T, Dist>::KnnResult VanillaKnn<T, Dist>::knn_search(VecView<const T> vec, size_t k) const
 	{
-		IndexVector result;
+		KnnResult result;
 		if (k == 0)
 			return result;
 
@@ -54,40 +60,44 @@ namespace anny
 
 		auto distances = this->calc_distances(query.view());
 
-		std::transform(distances.begin(), distances.begin() + k, std::back_inserter(result), [](auto el) { return el.first; });
+		std::transform(distances.begin(), distances.begin() + k, std::back_inserter(result), [](auto el) {
+			return std::make_pair(el.first, SearchDist::to_distance(el.second));
+			});
 		return result;
 	}
 
 	template <typename T, typename Dist>
-	IndexVector VanillaKnn<T, Dist>::radius_query(const std::vector<T>& vec, T radius)
+	typename VanillaKnn<T, Dist>::KnnResult VanillaKnn<T, Dist>::radius_search(VecView<const T> vec, T radius) const
 	{
-		IndexVector result;
-		const auto N = m_data.num_rows();
+		KnnResult result;
 		Vec<T> query(vec);
 
 		auto distances = this->calc_distances(query.view());
 
+		const T search_radius = SearchDist::from_distance(radius);
 		for (auto [i, dist] : distances)
 		{
-			if (dist > radius)
+			if (dist > search_radius)
 				break;
-			result.push_back(i);
+			result.push_back({ i, SearchDist::to_distance(dist) });
 		}
 		return result;
 	}
 
 	template <typename T, typename Dist>
-	std::vector<std::pair<index_t, T>> VanillaKnn<T, Dist>::calc_distances(VecView<T> vec)
+	std::vector<std::pair<index_t, T>> VanillaKnn<T, Dist>::calc_distances(VecView<T> vec) const
 	{
 		const auto N = m_data.num_rows();
 
-		assert(m_data[0].is_same_size(vec));
+		assert(m_data.num_cols() == vec.size());
 
-		std::vector<std::pair<index_t, T>> distances(N);
+		std::vector<T> batch;
+		distance_batch<typename SearchDist::type>(vec, m_data, 0, N, batch);
 
+		std::vector<std::pair<index_t, T>> distances(N);
 		for (size_t i = 0; i < N; i++)
 		{
-			distances[i] = { i, this->m_dist_func(m_data[i], vec) };
+			distances[i] = { i, batch[i] };
 		}
 
 		std::stable_sort(distances.begin(), distances.end(), [](auto& left, auto& right) {
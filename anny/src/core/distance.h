@@ -3,6 +3,11 @@
 #include <cmath>
 #include <type_traits>
 #include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
 #include "vec_view.h"
 #include "matrix.h"
 
@@ -57,13 +62,7 @@ template <typename T>
 T l2_distance_squared(VecView<T> v1, VecView<T> v2)
 {
 	assert(v1.is_same_size(v2));
-	T d{ 0 };
-	for (size_t i = 0; i < v1.size(); i++)
-	{
-		T sub = v1[i] - v2[i];
-		d += sub * sub;
-	}
-	return d;
+	return simd::l2_distance_squared<std::remove_cv_t<T>>(v1.begin(), v2.begin(), v1.size());
 }
 
 template <typename T>
@@ -97,7 +96,51 @@ T cosine_distance(VecView<T> v1, VecView<T> v2)
 }
 
 
-// TODO: add manhattan
+// distance for Maximum Inner Product Search (MIPS): the bigger the dot product, the closer the vectors
+template <typename T>
+T inner_product_distance(VecView<T> v1, VecView<T> v2)
+{
+	constexpr T one{ 1 };
+	return one - dot(v1, v2);
+}
+
+
+// L1
+template <typename T>
+T manhattan_distance(VecView<T> v1, VecView<T> v2)
+{
+	assert(v1.is_same_size(v2));
+	return simd::l1_distance<std::remove_cv_t<T>>(v1.begin(), v2.begin(), v1.size());
+}
+
+// L-infinity
+template <typename T>
+T chebyshev_distance(VecView<T> v1, VecView<T> v2)
+{
+	assert(v1.is_same_size(v2));
+	return simd::linf_distance<std::remove_cv_t<T>>(v1.begin(), v2.begin(), v1.size());
+}
+
+// number of different bits, for binary codes packed into unsigned integers (preferably uint64_t)
+template <typename T>
+T hamming_distance(VecView<T> v1, VecView<T> v2)
+{
+	static_assert(std::is_integral_v<T> && std::is_unsigned_v<T>, "Hamming distance is defined for bit strings packed into unsigned integers");
+	assert(v1.is_same_size(v2));
+	if constexpr (std::is_same_v<std::remove_cv_t<T>, uint64_t>)
+	{
+		return simd::hamming_distance(v1.begin(), v2.begin(), v1.size());
+	}
+	else
+	{
+		uint64_t d{ 0 };
+		for (size_t i = 0; i < v1.size(); i++)
+		{
+			d += simd::detail::popcount64(static_cast<uint64_t>(v1[i] ^ v2[i]));
+		}
+		return static_cast<T>(d);
+	}
+}
 
 
 enum class DistanceId: size_t
@@ -105,6 +148,10 @@ enum class DistanceId: size_t
 	L2 = 0,
 	L2_SQUARED,
 	COSINE,
+	INNER_PRODUCT,
+	MANHATTAN,
+	CHEBYSHEV,
+	HAMMING,
 	UNKNOWN = static_cast<size_t>(-1)
 };
 
@@ -118,8 +165,21 @@ DistanceFunc<T> distance_func_factory(DistanceId dist_id)
 	{
 	case DistanceId::L2:
 		return anny::l2_distance<T>;
+	case DistanceId::L2_SQUARED:
+		return anny::l2_distance_squared<T>;
 	case DistanceId::COSINE:
 		return anny::cosine_distance<T>;
+	case DistanceId::INNER_PRODUCT:
+		return anny::inner_product_distance<T>;
+	case DistanceId::MANHATTAN:
+		return anny::manhattan_distance<T>;
+	case DistanceId::CHEBYSHEV:
+		return anny::chebyshev_distance<T>;
+	case DistanceId::HAMMING:
+		if constexpr (std::is_integral_v<T> && std::is_unsigned_v<T>)
+			return anny::hamming_distance<T>;
+		else
+			throw std::runtime_error("Hamming distance is defined only for unsigned integer types");
 	default:
 		throw std::runtime_error("DistanceId unsupported");
 	}
@@ -127,15 +187,389 @@ DistanceFunc<T> distance_func_factory(DistanceId dist_id)
 
 struct L2Distance
 {
+	static constexpr DistanceId id = DistanceId::L2;
+
 	template <typename T>
-	inline T operator()(VecView<T> v1, VecView<T> v2) { return l2_distance(v1, v2); }
+	inline T operator()(VecView<T> v1, VecView<T> v2) const { return l2_distance(v1, v2); }
+};
+
+
+struct L2SquaredDistance
+{
+	static constexpr DistanceId id = DistanceId::L2_SQUARED;
+
+	template <typename T>
+	inline T operator()(VecView<T> v1, VecView<T> v2) const { return l2_distance_squared(v1, v2); }
 };
 
 
 struct CosineDistance
 {
+	static constexpr DistanceId id = DistanceId::COSINE;
+
 	template <typename T>
-	inline T operator()(VecView<T> v1, VecView<T> v2) { return cosine_distance(v1, v2); }
+	inline T operator()(VecView<T> v1, VecView<T> v2) const { return cosine_distance(v1, v2); }
 };
 
+
+struct InnerProductDistance
+{
+	static constexpr DistanceId id = DistanceId::INNER_PRODUCT;
+
+	template <typename T>
+	inline T operator()(VecView<T> v1, VecView<T> v2) const { return inner_product_distance(v1, v2); }
+};
+
+
+struct ManhattanDistance
+{
+	static constexpr DistanceId id = DistanceId::MANHATTAN;
+
+	template <typename T>
+	inline T operator()(VecView<T> v1, VecView<T> v2) const { return manhattan_distance(v1, v2); }
+};
+
+
+struct ChebyshevDistance
+{
+	static constexpr DistanceId id = DistanceId::CHEBYSHEV;
+
+	template <typename T>
+	inline T operator()(VecView<T> v1, VecView<T> v2) const { return chebyshev_distance(v1, v2); }
+};
+
+
+struct HammingDistance
+{
+	static constexpr DistanceId id = DistanceId::HAMMING;
+
+	template <typename T>
+	inline T operator()(VecView<T> v1, VecView<T> v2) const { return hamming_distance(v1, v2); }
+};
+
+
+/*
+	SearchDistance - distance which indices use internally to compare and rank candidates instead of Dist.
+	It must be a monotonic function of Dist, so radius thresholds can be converted into search space 
+	and found distances can be converted back. By default it is Dist itself.
+*/
+template <typename Dist>
+struct SearchDistance
+{
+	using type = Dist;
+
+	template <typename T>
+	static T from_distance(T d) { return d; }
+
+	template <typename T>
+	static T to_distance(T d) { return d; }
+};
+
+// L2 ordering is the same as squared L2 ordering, so search never needs sqrt
+template <>
+struct SearchDistance<L2Distance>
+{
+	using type = L2SquaredDistance;
+
+	template <typename T>
+	static T from_distance(T d) { return d * std::abs(d); }  // keeps sign (and monotonicity) for negative thresholds
+
+	template <typename T>
+	static T to_distance(T d) { return sqrt(d); }
+};
+
+
+/*
+	BorderDistance - lower bound of Dist between a point and any point lying on the other side of an axis-aligned border.
+	Takes the point's coordinate and the border's value along the splitting axis.
+	KDTree uses it to decide if the opposite branch may contain neighbors, so it is defined only for metrics
+	bounded by one coordinate difference (cosine and inner product distances of arbitrary vectors are not).
+*/
+template <typename Dist>
+struct BorderDistance
+{
+	static constexpr DistanceId id = Dist::id;
+	static_assert(id == DistanceId::L2 || id == DistanceId::MANHATTAN || id == DistanceId::CHEBYSHEV,
+		"BorderDistance (KDTree) supports L2, squared L2, Manhattan, Chebyshev and Hamming distances only");
+
+	// one coordinate difference never exceeds L1, L2 or L-infinity distance
+	template <typename T>
+	static T lower_bound(T coord, T split) { return (coord > split) ? coord - split : split - coord; }
+};
+
+template <>
+struct BorderDistance<L2SquaredDistance>
+{
+	template <typename T>
+	static T lower_bound(T coord, T split) { return (coord - split) * (coord - split); }
+};
+
+template <>
+struct BorderDistance<HammingDistance>
+{
+	// words on the other side of the border differ from the point's word, so at least 1 bit differs
+	template <typename T>
+	static T lower_bound(T /*coord*/, T /*split*/) { return T{ 1 }; }
+};
+
+
+/*
+	Static dispatch of distances. DistanceFunc from distance_func_factory is a std::function, so every call
+	is indirect and can't be inlined into the caller's loop. Instead, choose the metric at runtime once
+	and get code instantiated for the concrete functor type:
+
+		visit_distance<float>(id, [&](auto dist) {
+			HNSW<float, decltype(dist)> index;
+			...
+		});
+*/
+template <DistanceId id>
+struct DistanceById;
+
+template <> struct DistanceById<DistanceId::L2> { using type = L2Distance; };
+template <> struct DistanceById<DistanceId::L2_SQUARED> { using type = L2SquaredDistance; };
+template <> struct DistanceById<DistanceId::COSINE> { using type = CosineDistance; };
+template <> struct DistanceById<DistanceId::INNER_PRODUCT> { using type = InnerProductDistance; };
+template <> struct DistanceById<DistanceId::MANHATTAN> { using type = ManhattanDistance; };
+template <> struct DistanceById<DistanceId::CHEBYSHEV> { using type = ChebyshevDistance; };
+template <> struct DistanceById<DistanceId::HAMMING> { using type = HammingDistance; };
+
+template <DistanceId id>
+using distance_by_id_t = typename DistanceById<id>::type;
+
+
+// calls visitor with distance functor object of the type given by dist_id (only metrics applicable to T are instantiated)
+template <typename T, typename Visitor>
+decltype(auto) visit_distance(DistanceId dist_id, Visitor&& visitor)
+{
+	switch (dist_id)
+	{
+	case DistanceId::L2:
+		return visitor(L2Distance{});
+	case DistanceId::L2_SQUARED:
+		return visitor(L2SquaredDistance{});
+	case DistanceId::COSINE:
+		return visitor(CosineDistance{});
+	case DistanceId::INNER_PRODUCT:
+		return visitor(InnerProductDistance{});
+	case DistanceId::MANHATTAN:
+		return visitor(ManhattanDistance{});
+	case DistanceId::CHEBYSHEV:
+		return visitor(ChebyshevDistance{});
+	case DistanceId::HAMMING:
+		if constexpr (std::is_integral_v<T> && std::is_unsigned_v<T>)
+			return visitor(HammingDistance{});
+		else
+			throw std::runtime_error("Hamming distance is defined only for unsigned integer types");
+	default:
+		throw std::runtime_error("DistanceId unsupported");
+	}
+}
+
+
+/*
+	Batched one-to-many distances: out[i] = Dist(matrix[rows[i]], query).
+	L2, squared L2, cosine and inner product go through register-blocked kernels computing the query against
+	4 rows at once (the query chunk is loaded once per 4 rows), while rows of the next block are prefetched.
+	A tail shorter than 4 rows is padded with its last row, so a row gets bitwise the same distance wherever
+	it appears in a batch. Other metrics call Dist row by row, still with prefetching.
+	It is the primitive which all indices use for leaf scans and neighbor expansions.
+*/
+namespace detail
+{
+	template <typename Dist, typename = void>
+	struct has_distance_id : std::false_type {};
+
+	template <typename Dist>
+	struct has_distance_id<Dist, std::void_t<decltype(Dist::id)>> : std::true_type {};
+
+	template <typename Dist>
+	constexpr DistanceId distance_id_v()
+	{
+		if constexpr (has_distance_id<Dist>::value)
+			return Dist::id;
+		else
+			return DistanceId::UNKNOWN;
+	}
+
+	// query padded with zeros up to the row stride, kept in a per-thread buffer to avoid allocations
+	template <typename T>
+	const T* padded_query(const T* query, size_t dim, size_t stride)
+	{
+		thread_local std::vector<T> buffer;
+		buffer.assign(stride, T{ 0 });
+		std::copy(query, query + dim, buffer.begin());
+		return buffer.data();
+	}
+
+	template <typename Dist, typename Storage>
+	constexpr bool pads_query_v()
+	{
+		return has_padded_stride<Storage>::value && distance_id_v<Dist>() != DistanceId::UNKNOWN;
+	}
+
+	/*
+		Query pointer and number of elements to process against rows of the matrix.
+		Rows of storages with zero padding (MatrixStorageAligned, see padded_stride()) are processed up to the
+		padded stride: known metrics don't change on zero padding, so kernels run without tail loops.
+		Rows of borrowed memory, whose padding may hold anything, are processed up to num_cols.
+		The query has num_cols elements and is padded here, or padded stride elements padded by the caller already (pad_query).
+	*/
+	template <typename Dist, typename T, typename Storage>
+	std::pair<const T*, size_t> batch_query(const T* query, size_t dim, const Matrix<T, Storage>& matrix)
+	{
+		if constexpr (pads_query_v<Dist, Storage>())
+		{
+			const size_t stride = matrix.storage().padded_stride();
+			assert(dim == matrix.num_cols() || dim == stride);
+			if (dim != stride)
+				return { padded_query(query, dim, stride), stride };
+		}
+		else
+		{
+			assert(dim == matrix.num_cols());
+		}
+		return { query, dim };
+	}
+
+#ifdef ANNY_NO_PREFETCH
+	constexpr bool PREFETCH = false;
+#else
+	constexpr bool PREFETCH = true;  // software prefetching of the next rows of a batch, turned off by ANNY_USE_PREFETCH=OFF in CMake
+#endif
+
+	// row_ptr(i) returns pointer to the beginning of the i-th row of the batch
+	template <typename Dist, typename T, typename RowPtr>
+	void distance_batch(const T* query, size_t dim, size_t count, RowPtr row_ptr, T* out)
+	{
+		constexpr size_t BLOCK = 4;
+		constexpr DistanceId id = distance_id_v<Dist>();
+		constexpr bool IS_L2 = (id == DistanceId::L2 || id == DistanceId::L2_SQUARED);
+		constexpr bool IS_DOT = (id == DistanceId::COSINE || id == DistanceId::INNER_PRODUCT);
+
+		if constexpr (IS_L2 || IS_DOT)
+		{
+			const T* rows[BLOCK];
+			T block_out[BLOCK];
+			for (size_t i = 0; i < count; i += BLOCK)
+			{
+				const size_t block_size = std::min(BLOCK, count - i);
+				for (size_t j = 0; j < BLOCK; j++)
+					rows[j] = row_ptr(i + std::min(j, block_size - 1));
+
+				if constexpr (PREFETCH)
+				{
+					const size_t next_end = std::min(count, i + 2 * BLOCK);
+					for (size_t j = i + BLOCK; j < next_end; j++)
+						simd::prefetch_array(row_ptr(j), dim);
+				}
+
+				if constexpr (IS_L2)
+					simd::l2_distance_squared_x4(query, rows, dim, block_out);
+				else
+					simd::dot_x4(query, rows, dim, block_out);
+
+				for (size_t j = 0; j < block_size; j++)
+				{
+					if constexpr (id == DistanceId::L2)
+						out[i + j] = sqrt(block_out[j]);
+					else if constexpr (IS_DOT)
+						out[i + j] = T{ 1 } - block_out[j];
+					else
+						out[i + j] = block_out[j];
+				}
+			}
+		}
+		else
+		{
+			Dist dist;
+			VecView<const T> q(query, dim);
+			for (size_t i = 0; i < count; i++)
+			{
+				if (PREFETCH && i + 1 < count)
+					simd::prefetch_array(row_ptr(i + 1), dim);
+				out[i] = dist(VecView<const T>(row_ptr(i), dim), q);
+			}
+		}
+	}
+}
+
+/*
+	Query padded with zeros up to the padded stride of matrix rows in buffer, if distance_batch would pad it for Dist (otherwise the query itself).
+	distance_batch and distance_to_row take the padded query as is, so a query compared with many batches
+	(neighbor lists of a graph search) is copied once instead of once per batch.
+*/
+template <typename Dist, typename T, typename Storage>
+VecView<const T> pad_query(VecView<const T> query, const Matrix<T, Storage>& matrix, std::vector<T>& buffer)
+{
+	assert(query.size() == matrix.num_cols());
+	if constexpr (detail::pads_query_v<Dist, Storage>())
+	{
+		const size_t stride = matrix.storage().padded_stride();
+		if (stride != query.size())
+		{
+			buffer.assign(stride, T{ 0 });
+			std::copy(query.cbegin(), query.cend(), buffer.begin());
+			return VecView<const T>(buffer.data(), stride);
+		}
+	}
+	return query;
+}
+
+// row of matrix as a query for distance_batch, with the zero padding of the row when pad_query would pad it (no copy)
+template <typename Dist, typename T, typename Storage>
+VecView<const T> padded_row(const Matrix<T, Storage>& matrix, size_t row)
+{
+	if constexpr (detail::pads_query_v<Dist, Storage>())
+		return VecView<const T>(matrix[row].cbegin(), matrix.storage().padded_stride());
+	else
+		return matrix[row];
+}
+
+// distances from query to the rows of matrix listed in indices (any container of row numbers), out is resized to indices.size()
+template <typename Dist, typename Q, typename T, typename Storage, typename IndexContainer>
+void distance_batch(VecView<Q> query, const Matrix<T, Storage>& matrix, const IndexContainer& indices, std::vector<T>& out)
+{
+	static_assert(std::is_same_v<std::remove_cv_t<Q>, T>);
+	out.resize(indices.size());
+	if (indices.empty())
+		return;
+
+	auto first = std::begin(indices);
+	auto [q, dim] = detail::batch_query<Dist>(query.cbegin(), query.size(), matrix);
+	detail::distance_batch<Dist>(q, dim, out.size(), [&matrix, first](size_t i) {
+		return matrix[first[i]].cbegin();
+		}, out.data());
+}
+
+// distances from query to the contiguous range of matrix rows [first_row, last_row)
+template <typename Dist, typename Q, typename T, typename Storage>
+void distance_batch(VecView<Q> query, const Matrix<T, Storage>& matrix, size_t first_row, size_t last_row, std::vector<T>& out)
+{
+	static_assert(std::is_same_v<std::remove_cv_t<Q>, T>);
+	assert(first_row <= last_row && last_row <= matrix.num_rows());
+	out.resize(last_row - first_row);
+	if (out.empty())
+		return;
+
+	auto [q, dim] = detail::batch_query<Dist>(query.cbegin(), query.size(), matrix);
+	detail::distance_batch<Dist>(q, dim, out.size(), [&matrix, first_row](size_t i) {
+		return matrix[first_row + i].cbegin();
+		}, out.data());
+}
+
+// distance from query to one row of matrix, bitwise equal to the one distance_batch gives for this row
+template <typename Dist, typename Q, typename T, typename Storage>
+T distance_to_row(VecView<Q> query, const Matrix<T, Storage>& matrix, size_t row)
+{
+	static_assert(std::is_same_v<std::remove_cv_t<Q>, T>);
+
+	auto [q, dim] = detail::batch_query<Dist>(query.cbegin(), query.size(), matrix);
+	T out;
+	detail::distance_batch<Dist>(q, dim, 1, [&matrix, row](size_t) {
+		return matrix[row].cbegin();
+		}, &out);
+	return out;
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include "simd.h"
+
+// Optional BLAS backend (ANNY_USE_BLAS is defined by CMake when BLAS is found).
+// Fortran interface is used, because every BLAS implementation (reference, OpenBLAS, MKL...) exports it
+// and no cblas.h is needed.
+#ifdef ANNY_USE_BLAS
+extern "C"
+{
+	void sgemm_(const char* transa, const char* transb, const int* m, const int* n, const int* k,
+		const float* alpha, const float* a, const int* lda, const float* b, const int* ldb,
+		const float* beta, float* c, const int* ldc);
+	void dgemm_(const char* transa, const char* transb, const int* m, const int* n, const int* k,
+		const double* alpha, const double* a, const int* lda, const double* b, const int* ldb,
+		const double* beta, double* c, const int* ldc);
+}
+#endif
+
+
+namespace anny
+{
+namespace gemm
+{
+
+/*
+	Blocked matrix multiplication C = A * B^T for row-major A (M x K), B (N x K) and C (M x N),
+	i.e. every element of C is a dot product of a row of A and a row of B. It is the building block
+	of many-to-many distances, where A holds queries and B holds the dataset.
+
+	Implementation follows the classic GotoBLAS/BLIS scheme: blocks of B (NC x KC) and A (MC x KC)
+	are packed into panels of NR and MR rows laid out "k-major", so a micro-kernel reads both panels
+	sequentially and keeps an MR x NR tile of C in registers, doing MR * NR / lanes FMAs per loaded vector.
+*/
+
+// blocking parameters: packed KC x NC panel of B stays in L2, packed MC x KC block of A stays in L1/L2
+inline constexpr size_t KC = 256;
+inline constexpr size_t MC = 72;   // multiple of every MR
+inline constexpr size_t NC = 256;  // multiple of every NR
+
+
+template <typename T>
+struct MicroKernel
+{
+	// adds A panel (kc x mr) * B panel (kc x nr) to the m x n (m <= mr, n <= nr) tile of C
+	using func_t = void(*)(size_t kc, const T* a, const T* b, T* c, size_t ldc, size_t m, size_t n);
+
+	size_t mr{ 0 };
+	size_t nr{ 0 };
+	func_t func{ nullptr };
+};
+
+
+namespace detail
+{
+	template <typename T>
+	inline void add_tile(const T* tile, size_t nr, T* c, size_t ldc, size_t m, size_t n)
+	{
+		for (size_t i = 0; i < m; i++)
+		{
+			for (size_t j = 0; j < n; j++)
+				c[i * ldc + j] += tile[i * nr + j];
+		}
+	}
+
+	template <typename T, size_t MR, size_t NR>
+	void micro_kernel_scalar(size_t kc, const T* a, const T* b, T* c, size_t ldc, size_t m, size_t n)
+	{
+		T acc[MR * NR] = {};
+		for (size_t k = 0; k < kc; k++, a += MR, b += NR)
+		{
+			for (size_t i = 0; i < MR; i++)
+			{
+				for (size_t j = 0; j < NR; j++)
+					acc[i * NR + j] += a[i] * b[j];
+			}
+		}
+		add_tile(acc, NR, c, ldc, m, n);
+	}
+
+#ifdef ANNY_SIMD_X86
+
+	// AVX2 + FMA: tile of 6 rows x 2 registers
+
+	ANNY_TARGET("avx2,fma") inline __m256 avx2_zero(float) { return _mm256_setzero_ps(); }
+	ANNY_TARGET("avx2,fma") inline __m256d avx2_zero(double) { return _mm256_setzero_pd(); }
+	ANNY_TARGET("avx2,fma") inline __m256 avx2_load(const float* p) { return _mm256_loadu_ps(p); }
+	ANNY_TARGET("avx2,fma") inline __m256d avx2_load(const double* p) { return _mm256_loadu_pd(p); }
+	ANNY_TARGET("avx2,fma") inline void avx2_store(float* p, __m256 v) { _mm256_storeu_ps(p, v); }
+	ANNY_TARGET("avx2,fma") inline void avx2_store(double* p, __m256d v) { _mm256_storeu_pd(p, v); }
+	ANNY_TARGET("avx2,fma") inline __m256 avx2_set1(float x) { return _mm256_set1_ps(x); }
+	ANNY_TARGET("avx2,fma") inline __m256d avx2_set1(double x) { return _mm256_set1_pd(x); }
+	ANNY_TARGET("avx2,fma") inline __m256 avx2_fmadd(__m256 a, __m256 b, __m256 c) { return _mm256_fmadd_ps(a, b, c); }
+	ANNY_TARGET("avx2,fma") inline __m256d avx2_fmadd(__m256d a, __m256d b, __m256d c) { return _mm256_fmadd_pd(a, b, c); }
+
+	template <typename T>
+	ANNY_TARGET("avx2,fma")
+	void micro_kernel_avx2(size_t kc, const T* a, const T* b, T* c, size_t ldc, size_t m, size_t n)
+	{
+		constexpr size_t W = 32 / sizeof(T);  // lanes per register
+		constexpr size_t NR = 2 * W;
+
+		auto c00 = avx2_zero(T{}), c01 = avx2_zero(T{});
+		auto c10 = avx2_zero(T{}), c11 = avx2_zero(T{});
+		auto c20 = avx2_zero(T{}), c21 = avx2_zero(T{});
+		auto c30 = avx2_zero(T{}), c31 = avx2_zero(T{});
+		auto c40 = avx2_zero(T{}), c41 = avx2_zero(T{});
+		auto c50 = avx2_zero(T{}), c51 = avx2_zero(T{});
+		for (size_t k = 0; k < kc; k++, a += 6, b += NR)
+		{
+			auto b0 = avx2_load(b);
+			auto b1 = avx2_load(b + W);
+			auto ai = avx2_set1(a[0]); c00 = avx2_fmadd(ai, b0, c00); c01 = avx2_fmadd(ai, b1, c01);
+			ai = avx2_set1(a[1]); c10 = avx2_fmadd(ai, b0, c10); c11 = avx2_fmadd(ai, b1, c11);
+			ai = avx2_set1(a[2]); c20 = avx2_fmadd(ai, b0, c20); c21 = avx2_fmadd(ai, b1, c21);
+			ai = avx2_set1(a[3]); c30 = avx2_fmadd(ai, b0, c30); c31 = avx2_fmadd(ai, b1, c31);
+			ai = avx2_set1(a[4]); c40 = avx2_fmadd(ai, b0, c40); c41 = avx2_fmadd(ai, b1, c41);
+			ai = avx2_set1(a[5]); c50 = avx2_fmadd(ai, b0, c50); c51 = avx2_fmadd(ai, b1, c51);
+		}
+
+		alignas(64) T tile[6 * NR];
+		avx2_store(tile + 0 * NR, c00); avx2_store(tile + 0 * NR + W, c01);
+		avx2_store(tile + 1 * NR, c10); avx2_store(tile + 1 * NR + W, c11);
+		avx2_store(tile + 2 * NR, c20); avx2_store(tile + 2 * NR + W, c21);
+		avx2_store(tile + 3 * NR, c30); avx2_store(tile + 3 * NR + W, c31);
+		avx2_store(tile + 4 * NR, c40); avx2_store(tile + 4 * NR + W, c41);
+		avx2_store(tile + 5 * NR, c50); avx2_store(tile + 5 * NR + W, c51);
+		add_tile(tile, NR, c, ldc, m, n);
+	}
+
+	// AVX-512F: tile of 6 rows x 2 registers
+
+	ANNY_TARGET("avx512f") inline __m512 avx512_zero(float) { return _mm512_setzero_ps(); }
+	ANNY_TARGET("avx512f") inline __m512d avx512_zero(double) { return _mm512_setzero_pd(); }
+	ANNY_TARGET("avx512f") inline __m512 avx512_load(const float* p) { return _mm512_loadu_ps(p); }
+	ANNY_TARGET("avx512f") inline __m512d avx512_load(const double* p) { return _mm512_loadu_pd(p); }
+	ANNY_TARGET("avx512f") inline void avx512_store(float* p, __m512 v) { _mm512_storeu_ps(p, v); }
+	ANNY_TARGET("avx512f") inline void avx512_store(double* p, __m512d v) { _mm512_storeu_pd(p, v); }
+	ANNY_TARGET("avx512f") inline __m512 avx512_set1(float x) { return _mm512_set1_ps(x); }
+	ANNY_TARGET("avx512f") inline __m512d avx512_set1(double x) { return _mm512_set1_pd(x); }
+	ANNY_TARGET("avx512f") inline __m512 avx512_fmadd(__m512 a, __m512 b, __m512 c) { return _mm512_fmadd_ps(a, b, c); }
+	ANNY_TARGET("avx512f") inline __m512d avx512_fmadd(__m512d a, __m512d b, __m512d c) { return _mm512_fmadd_pd(a, b, c); }
+
+	template <typename T>
+	ANNY_TARGET("avx512f")
+	void micro_kernel_avx512(size_t kc, const T* a, const T* b, T* c, size_t ldc, size_t m, size_t n)
+	{
+		constexpr size_t W = 64 / sizeof(T);  // lanes per register
+		constexpr size_t NR = 2 * W;
+
+		auto c00 = avx512_zero(T{}), c01 = avx512_zero(T{});
+		auto c10 = avx512_zero(T{}), c11 = avx512_zero(T{});
+		auto c20 = avx512_zero(T{}), c21 = avx512_zero(T{});
+		auto c30 = avx512_zero(T{}), c31 = avx512_zero(T{});
+		auto c40 = avx512_zero(T{}), c41 = avx512_zero(T{});
+		auto c50 = avx512_zero(T{}), c51 = avx512_zero(T{});
+		for (size_t k = 0; k < kc; k++, a += 6, b += NR)
+		{
+			auto b0 = avx512_load(b);
+			auto b1 = avx512_load(b + W);
+			auto ai = avx512_set1(a[0]); c00 = avx512_fmadd(ai, b0, c00); c01 = avx512_fmadd(ai, b1, c01);
+			ai = avx512_set1(a[1]); c10 = avx512_fmadd(ai, b0, c10); c11 = avx512_fmadd(ai, b1, c11);
+			ai = avx512_set1(a[2]); c20 = avx512_fmadd(ai, b0, c20); c21 = avx512_fmadd(ai, b1, c21);
+			ai = avx512_set1(a[3]); c30 = avx512_fmadd(ai, b0, c30); c31 = avx512_fmadd(ai, b1, c31);
+			ai = avx512_set1(a[4]); c40 = avx512_fmadd(ai, b0, c40); c41 = avx512_fmadd(ai, b1, c41);
+			ai = avx512_set1(a[5]); c50 = avx512_fmadd(ai, b0, c50); c51 = avx512_fmadd(ai, b1, c51);
+		}
+
+		alignas(64) T tile[6 * NR];
+		avx512_store(tile + 0 * NR, c00); avx512_store(tile + 0 * NR + W, c01);
+		avx512_store(tile + 1 * NR, c10); avx512_store(tile + 1 * NR + W, c11);
+		avx512_store(tile + 2 * NR, c20); avx512_store(tile + 2 * NR + W, c21);
+		avx512_store(tile + 3 * NR, c30); avx512_store(tile + 3 * NR + W, c31);
+		avx512_store(tile + 4 * NR, c40); avx512_store(tile + 4 * NR + W, c41);
+		avx512_store(tile + 5 * NR, c50); avx512_store(tile + 5 * NR + W, c51);
+		add_tile(tile, NR, c, ldc, m, n);
+	}
+
+#endif  // ANNY_SIMD_X86
+
+	/*
+		Packs rows [0, m) x columns [0, kc) of row-major src into panels of mr rows.
+		Inside a panel the values are stored k-major: kc groups of mr values, one value per row.
+		Rows of the last panel beyond m are zero-padded.
+	*/
+	template <typename T>
+	void pack_panels(const T* src, size_t ld, size_t m, size_t kc, size_t mr, T* dst)
+	{
+		for (size_t p = 0; p < m; p += mr, dst += mr * kc)
+		{
+			const size_t rows = std::min(mr, m - p);
+			for (size_t r = 0; r < rows; r++)
+			{
+				const T* s = src + (p + r) * ld;
+				for (size_t k = 0; k < kc; k++)
+					dst[k * mr + r] = s[k];
+			}
+			for (size_t r = rows; r < mr; r++)
+			{
+				for (size_t k = 0; k < kc; k++)
+					dst[k * mr + r] = T{ 0 };
+			}
+		}
+	}
+
+	inline size_t round_up(size_t x, size_t step) { return (x + step - 1) / step * step; }
+}
+
+
+template <typename T>
+MicroKernel<T> make_micro_kernel(simd::InstructionSet isa)
+{
+#ifdef ANNY_SIMD_X86
+	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+	{
+		switch (isa)
+		{
+		case simd::InstructionSet::AVX512:
+			return { 6, 2 * 64 / sizeof(T), detail::micro_kernel_avx512<T> };
+		case simd::InstructionSet::AVX2:
+			return { 6, 2 * 32 / sizeof(T), detail::micro_kernel_avx2<T> };
+		default: break;
+		}
+	}
+#endif
+	return { 4, 4, detail::micro_kernel_scalar<T, 4, 4> };
+}
+
+
+// C = A * B^T with the built-in blocked implementation, C is overwritten
+template <typename T>
+void gemm_nt_blocked(size_t M, size_t N, size_t K, const T* A, size_t lda, const T* B, size_t ldb, T* C, size_t ldc)
+{
+	for (size_t i = 0; i < M; i++)
+		std::fill(C + i * ldc, C + i * ldc + N, T{ 0 });
+	if (M == 0 || N == 0 || K == 0)
+		return;
+
+	const auto kernel = make_micro_kernel<T>(simd::get_instruction_set());
+	std::vector<T> packed_a(detail::round_up(MC, kernel.mr) * KC);
+	std::vector<T> packed_b(detail::round_up(NC, kernel.nr) * KC);
+
+	for (size_t jc = 0; jc < N; jc += NC)
+	{
+		const size_t nc = std::min(NC, N - jc);
+		for (size_t pc = 0; pc < K; pc += KC)
+		{
+			const size_t kc = std::min(KC, K - pc);
+			detail::pack_panels(B + jc * ldb + pc, ldb, nc, kc, kernel.nr, packed_b.data());
+
+			for (size_t ic = 0; ic < M; ic += MC)
+			{
+				const size_t mc = std::min(MC, M - ic);
+				detail::pack_panels(A + ic * lda + pc, lda, mc, kc, kernel.mr, packed_a.data());
+
+				for (size_t jr = 0; jr < nc; jr += kernel.nr)
+				{
+					for (size_t ir = 0; ir < mc; ir += kernel.mr)
+					{
+						kernel.func(kc, packed_a.data() + ir * kc, packed_b.data() + jr * kc,
+							C + (ic + ir) * ldc + jc + jr, ldc,
+							std::min(kernel.mr, mc - ir), std::min(kernel.nr, nc - jr));
+					}
+				}
+			}
+		}
+	}
+}
+
+
+// true if gemm_nt is backed by BLAS for type T
+template <typename T>
+constexpr bool uses_blas()
+{
+#ifdef ANNY_USE_BLAS
+	return std::is_same_v<T, float> || std::is_same_v<T, double>;
+#else
+	return false;
+#endif
+}
+
+
+// C = A * B^T, C is overwritten. Goes to BLAS if the library is built with it, otherwise to gemm_nt_blocked.
+template <typename T>
+void gemm_nt(size_t M, size_t N, size_t K, const T* A, size_t lda, const T* B, size_t ldb, T* C, size_t ldc)
+{
+#ifdef ANNY_USE_BLAS
+	if constexpr (uses_blas<T>())
+	{
+		if (M == 0 || N == 0 || K == 0)
+			return gemm_nt_blocked(M, N, K, A, lda, B, ldb, C, ldc);  // degenerate sizes are illegal arguments for BLAS
+		// column-major BLAS sees row-major C^T = B * A^T
+		const char trans = 'T', no_trans = 'N';
+		const int m = static_cast<int>(N), n = static_cast<int>(M), k = static_cast<int>(K);
+		const int ia = static_cast<int>(lda), ib = static_cast<int>(ldb), ic = static_cast<int>(ldc);
+		const T one{ 1 }, zero{ 0 };
+		if constexpr (std::is_same_v<T, float>)
+			sgemm_(&trans, &no_trans, &m, &n, &k, &one, B, &ib, A, &ia, &zero, C, &ic);
+		else
+			dgemm_(&trans, &no_trans, &m, &n, &k, &one, B, &ib, A, &ia, &zero, C, &ic);
+		return;
+	}
+#endif
+	gemm_nt_blocked(M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+}
+}
\ No newline at end of file
@@ -1,13 +1,60 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <limits>
 #include <stdexcept>
 #include <string>
 
 namespace anny
 {
+    /*
+    * Breadth-first (Cuthill-McKee) order of vertices 0..num_vertices-1: vertices close in the graph get close positions,
+    * so numbering vertices by it improves memory locality of graph traversals.
+    * neighbors(v) returns a range of vertices adjacent to v, edges may be directed.
+    * The search starts from first and visits neighbors of a vertex in order of increasing degree,
+    * vertices not reachable from first start new searches in order of their numbers.
+    * Returns order[new_number] = old_number.
+    */
+    template <typename vertex_t, typename NeighborsFunc>
+    std::vector<vertex_t> bfs_order(size_t num_vertices, vertex_t first, NeighborsFunc neighbors)
+    {
+        std::vector<vertex_t> order;
+        order.reserve(num_vertices);
+        std::vector<bool> visited(num_vertices, false);
+        std::vector<std::pair<size_t, vertex_t>> next;  // (degree, vertex) of not visited neighbors
+
+        auto search_from = [&](vertex_t root) {
+            if (visited[root])
+                return;
+            visited[root] = true;
+            order.push_back(root);
+            for (size_t head = order.size() - 1; head < order.size(); head++)
+            {
+                next.clear();
+                for (const auto& u : neighbors(order[head]))
+                {
+                    if (!visited[u])
+                    {
+                        visited[u] = true;
+                        next.push_back({ neighbors(u).size(), u });
+                    }
+                }
+                std::sort(next.begin(), next.end());
+                for (const auto& [degree, u] : next)
+                    order.push_back(u);
+            }
+        };
+
+        if (num_vertices > 0)
+            search_from(first);
+        for (size_t v = 0; v < num_vertices; v++)
+            search_from(static_cast<vertex_t>(v));
+        return order;
+    }
+
     /*
     * Undirected Graph using adjacent lists.
     */
@@ -114,21 +161,81 @@ namespace anny
             return m_adj.empty();
         }
 
+        /*
+        * Breadth-first order of all vertices, see anny::bfs_order(). Vertex ids may be any (not only 0..num_vertices()-1):
+        * the search runs over positions of vertices sorted by id, so unreachable vertices start new searches in order of ids.
+        */
+        std::vector<vertex_t> bfs_order(vertex_t first) const
+        {
+            if (is_empty())
+                return {};
+            if (!has_vertex(first))
+                throw std::out_of_range("No such vertex: " + std::to_string(first));
+
+            std::vector<vertex_t> ids;
+            ids.reserve(num_vertices());
+            for (const auto& [v, adj_list] : m_adj)
+                ids.push_back(v);
+            std::sort(ids.begin(), ids.end());
+
+            std::unordered_map<vertex_t, size_t> positions;
+            for (size_t i = 0; i < ids.size(); i++)
+                positions[ids[i]] = i;
+            std::vector<std::vector<size_t>> adj(ids.size());
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                for (const auto& u : get_adj_vertices(ids[i]))
+                    adj[i].push_back(positions.at(u));
+            }
+
+            auto order = anny::bfs_order(ids.size(), positions.at(first), [&adj](size_t i) -> const std::vector<size_t>& {
+                return adj[i];
+                });
+            std::vector<vertex_t> result(order.size());
+            for (size_t i = 0; i < order.size(); i++)
+                result[i] = ids[order[i]];
+            return result;
+        }
+
+        // renumbers vertices: vertex order[i] becomes vertex i, order must list every vertex once
+        void relabel(const std::vector<vertex_t>& order)
+        {
+            if (order.size() != num_vertices())
+                throw std::invalid_argument("Order must list all vertices of the graph");
+
+            std::unordered_map<vertex_t, vertex_t> new_ids;
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                if (!has_vertex(order[i]) || !new_ids.insert({ order[i], static_cast<vertex_t>(i) }).second)
+                    throw std::invalid_argument("Order must list every vertex of the graph once");
+            }
+
+            std::unordered_map<vertex_t, std::vector<vertex_t>> adj;
+            for (const auto& [v, adj_list] : m_adj)
+            {
+                auto& new_list = adj[new_ids[v]];
+                new_list.reserve(adj_list.size());
+                for (const auto& u : adj_list)
+                    new_list.push_back(new_ids[u]);
+            }
+            m_adj = std::move(adj);
+        }
+
     private:
         size_t calc_num_edges() const
         {
-            std::vector<bool> visited(num_vertices());
+            std::unordered_set<vertex_t> visited;
             size_t m = 0;
             for (const auto& [u, adj_list]: m_adj)
             {
                 for (const auto& v : adj_list)
                 {
-                    if (!visited[v])
+                    if (visited.count(v) == 0)
                     {
                         m++;
                     }
                 }
-                visited[u] = true;
+                visited.insert(u);
             }
             return m;
         }
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "simd.h"
+
+
+namespace anny
+{
+    /*
+        HnswGraph - link store of a layered HNSW graph with a fixed max number of links per node and level.
+        Level 0 (all nodes) is one contiguous array with (max_links0 + 1) uint32 slots per node: links count, then links.
+        Upper levels of a node (only ~1/M of nodes have them) are blocks of (max_links + 1) slots in a side array,
+        located by the per-node offset. So links of any node at any level are found by one pointer offset,
+        without hashing or a separate allocation per node, and the graph is saved and loaded as a few flat arrays.
+        The arrays may also be attached from memory of someone else (e.g. a mapped index file) without copying,
+        they are copied into own memory when the graph grows.
+        Links are directed. The store is not synchronized: concurrent writers to the same node must be serialized by the caller.
+    */
+    class HnswGraph
+    {
+    public:
+        using id_t = uint32_t;
+        using level_t = int;
+
+        static constexpr id_t MAX_NODES = std::numeric_limits<id_t>::max();
+        static constexpr level_t MAX_LEVEL = 8;  // top level of any node
+
+        // links of a node at a level
+        class Links
+        {
+        public:
+            Links(const id_t* data, size_t size) : m_data{ data }, m_size{ size } {}
+
+            const id_t* begin() const noexcept { return m_data; }
+            const id_t* end() const noexcept { return m_data + m_size; }
+            size_t size() const noexcept { return m_size; }
+            bool empty() const noexcept { return m_size == 0; }
+            id_t operator[](size_t i) const noexcept { return m_data[i]; }
+
+        private:
+            const id_t* m_data;
+            size_t m_size;
+        };
+
+        // flat arrays of the graph as raw memory: levels, upper level offsets, level 0 links, upper level links
+        static constexpr size_t NUM_ARRAYS = 4;
+        struct RawArray
+        {
+            const void* data;
+            size_t size;  // in bytes
+        };
+        using RawArrays = std::array<RawArray, NUM_ARRAYS>;
+
+        HnswGraph() = default;
+
+        HnswGraph(size_t max_links0, size_t max_links)
+            : m_maxLinks0{ max_links0 }
+            , m_maxLinks{ max_links }
+        {}
+
+        size_t num_nodes() const noexcept { return m_levels.size(); }
+        size_t max_links(level_t level) const noexcept { return level == 0 ? m_maxLinks0 : m_maxLinks; }
+
+        // adds slots for new nodes, they have no levels and no links until set_level()
+        void resize(size_t num_nodes)
+        {
+            if (num_nodes > MAX_NODES)
+                throw std::runtime_error("HnswGraph supports up to 2^32 - 1 nodes");
+            own_arrays();
+            m_levels.resize(num_nodes, NO_LEVEL);
+            m_upperOffsets.resize(num_nodes, NO_OFFSET);
+            m_level0.resize(num_nodes * block_size(0), 0);
+        }
+
+        // makes room for num_nodes nodes, so that resize() up to it does not reallocate level 0 links
+        void reserve(size_t num_nodes)
+        {
+            own_arrays();
+            m_levels.reserve(num_nodes);
+            m_upperOffsets.reserve(num_nodes);
+            m_level0.reserve(num_nodes * block_size(0));
+        }
+
+        // sets top level of a node and allocates its (empty) upper levels, once per node
+        void set_level(id_t node, level_t level)
+        {
+            assert(node < num_nodes() && level >= 0 && m_levels[node] == NO_LEVEL);
+            m_levels[node] = level;
+            if (level > 0)
+            {
+                own_arrays();
+                m_upperOffsets[node] = m_upper.size();
+                m_upper.resize(m_upper.size() + level * block_size(1), 0);
+            }
+        }
+
+        // top level of a node, -1 if it is not in the graph yet
+        level_t level(id_t node) const noexcept { return m_levels[node]; }
+
+        Links links(id_t node, level_t level) const noexcept
+        {
+            const id_t* block = this->block(node, level);
+            return Links(block + 1, block[0]);
+        }
+
+        // hint to load links of a node at a level into cache before they are read
+        void prefetch_links(id_t node, level_t level) const noexcept
+        {
+            simd::prefetch(block(node, level));
+        }
+
+        // replaces links of a node at a level, there must be at most max_links(level) of them
+        template <typename Container>
+        void set_links(id_t node, level_t level, const Container& links)
+        {
+            assert(links.size() <= max_links(level));
+            id_t* block = this->block(node, level);
+            block[0] = static_cast<id_t>(links.size());
+            size_t i = 1;
+            for (const auto& link : links)
+                block[i++] = static_cast<id_t>(link);
+        }
+
+        // appends a link, returns false if the node has max_links(level) links already
+        bool add_link(id_t node, level_t level, id_t link)
+        {
+            id_t* block = this->block(node, level);
+            if (block[0] >= max_links(level))
+                return false;
+            block[1 + block[0]] = link;
+            block[0]++;
+            return true;
+        }
+
+        // memory of the flat arrays, to be written as they are and attached back by attach()
+        RawArrays raw_arrays() const noexcept
+        {
+            return { {
+                { m_levels.data(), m_levels.size() * sizeof(level_t) },
+                { m_upperOffsets.data(), m_upperOffsets.size() * sizeof(uint64_t) },
+                { m_level0.data(), m_level0.size() * sizeof(id_t) },
+                { m_upper.data(), m_upper.size() * sizeof(id_t) }
+            } };
+        }
+
+        /*
+            Uses arrays in memory of owner (as raw_arrays() gave them) without copying, owner is kept alive by the graph.
+            Sizes, levels, upper level offsets and links of every node are checked, so corrupt arrays throw here
+            instead of reading out of bounds later. Links may be modified in place, so the memory
+            must be writable (e.g. a private mapping), if links are changed after attaching.
+        */
+        void attach(size_t max_links0, size_t max_links, const RawArrays& arrays, std::shared_ptr<void> owner)
+        {
+            HnswGraph g(max_links0, max_links);
+            const size_t num_nodes = arrays[0].size / sizeof(level_t);
+            const size_t upper_size = arrays[3].size / sizeof(id_t);
+            if (num_nodes > MAX_NODES || arrays[0].size != num_nodes * sizeof(level_t) ||
+                arrays[1].size != num_nodes * sizeof(uint64_t) || arrays[2].size != num_nodes * g.block_size(0) * sizeof(id_t) ||
+                arrays[3].size != upper_size * sizeof(id_t) || upper_size % g.block_size(1) != 0)
+                throw std::runtime_error("Bad HNSW graph: inconsistent sizes");
+
+            g.m_levels.attach(arrays[0].data, num_nodes);
+            g.m_upperOffsets.attach(arrays[1].data, num_nodes);
+            g.m_level0.attach(arrays[2].data, num_nodes * g.block_size(0));
+            g.m_upper.attach(arrays[3].data, upper_size);
+
+            for (id_t node = 0; node < num_nodes; node++)
+            {
+                const level_t level = g.m_levels[node];
+                if (level < NO_LEVEL || level > MAX_LEVEL)
+                    throw std::runtime_error("Bad HNSW graph: bad level");
+                if (level > 0 && (g.m_upperOffsets[node] > upper_size || level * g.block_size(1) > upper_size - g.m_upperOffsets[node]))
+                    throw std::runtime_error("Bad HNSW graph: bad upper level offset");
+                for (level_t lc = 0; lc <= level; lc++)
+                {
+                    const id_t* block = g.block(node, lc);
+                    if (block[0] > g.max_links(lc) || std::any_of(block + 1, block + 1 + block[0], [num_nodes](id_t e) { return e >= num_nodes; }))
+                        throw std::runtime_error("Bad HNSW graph: bad links");
+                }
+            }
+            g.m_owner = std::move(owner);
+            *this = std::move(g);
+        }
+
+    private:
+        /*
+            Array - elements in own vector, or in attached memory of the graph owner until own() copies them.
+            Grows like a vector, growing attached array owns it first.
+        */
+        template <typename V>
+        class Array
+        {
+        public:
+            Array() = default;
+            Array(Array&& other) noexcept { *this = std::move(other); }
+
+            // a copy always owns its elements
+            Array(const Array& other)
+                : m_own(other.m_data, other.m_data + other.m_size)
+            {
+                sync();
+            }
+
+            Array& operator=(Array&& other) noexcept
+            {
+                const bool attached = other.is_attached();
+                m_own = std::move(other.m_own);
+                m_data = attached ? other.m_data : m_own.data();  // moved vector keeps its buffer
+                m_size = other.m_size;
+                other.reset();
+                return *this;
+            }
+
+            Array& operator=(const Array& other)
+            {
+                if (this != &other)
+                    *this = Array(other);
+                return *this;
+            }
+
+            size_t size() const noexcept { return m_size; }
+            V* data() noexcept { return m_data; }
+            const V* data() const noexcept { return m_data; }
+            V& operator[](size_t i) noexcept { return m_data[i]; }
+            const V& operator[](size_t i) const noexcept { return m_data[i]; }
+
+            void resize(size_t size, const V& value = V{}) { own(); m_own.resize(size, value); sync(); }
+            void reserve(size_t size) { own(); m_own.reserve(size); sync(); }
+
+            void attach(const void* data, size_t size)
+            {
+                m_own = std::vector<V>();
+                m_data = static_cast<V*>(const_cast<void*>(data));
+                m_size = size;
+            }
+
+            void own()
+            {
+                if (is_attached())
+                {
+                    m_own.assign(m_data, m_data + m_size);
+                    sync();
+                }
+            }
+
+        private:
+            bool is_attached() const noexcept { return m_data != m_own.data(); }
+            void sync() noexcept { m_data = m_own.data(); m_size = m_own.size(); }
+            void reset() noexcept { m_own.clear(); sync(); }
+
+        private:
+            std::vector<V> m_own;
+            V* m_data{ nullptr };
+            size_t m_size{ 0 };
+        };
+
+        static constexpr level_t NO_LEVEL = -1;
+        static constexpr uint64_t NO_OFFSET = std::numeric_limits<uint64_t>::max();
+
+        size_t block_size(level_t level) const noexcept { return max_links(level) + 1; }
+
+        // copies attached arrays into own memory before they grow
+        void own_arrays()
+        {
+            if (!m_owner)
+                return;
+            m_levels.own();
+            m_upperOffsets.own();
+            m_level0.own();
+            m_upper.own();
+            m_owner.reset();
+        }
+
+        id_t* block(id_t node, level_t level) noexcept
+        {
+            return const_cast<id_t*>(static_cast<const HnswGraph*>(this)->block(node, level));
+        }
+
+        const id_t* block(id_t node, level_t level) const noexcept
+        {
+            assert(node < num_nodes() && level <= m_levels[node]);
+            if (level == 0)
+                return m_level0.data() + node * block_size(0);
+            return m_upper.data() + m_upperOffsets[node] + (level - 1) * block_size(level);
+        }
+
+    private:
+        size_t m_maxLinks0{ 0 };
+        size_t m_maxLinks{ 0 };
+        Array<level_t> m_levels;          // top level of every node
+        Array<uint64_t> m_upperOffsets;   // start of node's level 1 block in m_upper
+        Array<id_t> m_level0;             // num_nodes blocks of (max_links0 + 1)
+        Array<id_t> m_upper;              // level blocks of (max_links + 1)
+        std::shared_ptr<void> m_owner;    // keeps attached memory alive
+    };
+}
\ No newline at end of file
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ANNY_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace anny
+{
+
+/*
+    MappedFile - a whole file mapped into memory, unmapped in the destructor.
+    The mapping is read-only by default: a stray write faults instead of silently copying the page.
+    Owners which patch the memory in place opt in to COPY_ON_WRITE: a private mapping, where writes copy
+    the touched pages and never reach the file.
+    Pages are read by the OS on first access, so mapping is instant whatever the size of the file.
+    Available on POSIX systems only.
+*/
+class MappedFile
+{
+public:
+    enum class Advice
+    {
+        NORMAL,
+        SEQUENTIAL,  // aggressive read-ahead, pages may be freed soon after access
+        RANDOM,      // no read-ahead
+        WILLNEED,    // start reading pages in background
+        DONTNEED     // pages may be dropped from memory (together with private modifications)
+    };
+
+    enum class Mode
+    {
+        READ_ONLY,
+        COPY_ON_WRITE
+    };
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+    {
+        swap(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        MappedFile tmp(std::move(other));
+        swap(tmp);
+        return *this;
+    }
+
+    explicit MappedFile(const std::string& path, Mode mode = Mode::READ_ONLY)
+    {
+#ifdef ANNY_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open file: " + path);
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to map empty file: " + path);
+        }
+        const size_t size = static_cast<size_t>(st.st_size);
+
+        const int protection = (mode == Mode::COPY_ON_WRITE) ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* addr = ::mmap(nullptr, size, protection, MAP_PRIVATE, fd, 0);
+        ::close(fd);  // mapping keeps its own reference to the file
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("Failed to map file: " + path);
+        m_data = static_cast<char*>(addr);
+        m_size = size;
+#else
+        (void)mode;
+        throw std::runtime_error("Memory mapped files are not supported on this platform");
+#endif
+    }
+
+    ~MappedFile()
+    {
+        unmap();
+    }
+
+    char* data() noexcept { return m_data; }
+    const char* data() const noexcept { return m_data; }
+    size_t size() const noexcept { return m_size; }
+
+    // hint the OS about the expected access to bytes [offset, offset + length)
+    void advise(Advice advice, size_t offset, size_t length) const
+    {
+#ifdef ANNY_HAS_MMAP
+        if (!m_data || offset >= m_size || length == 0)
+            return;
+
+        // madvise needs a page aligned address
+        const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const size_t first = offset / page * page;
+        const size_t last = std::min(offset + length, m_size);
+        ::madvise(m_data + first, last - first, to_native(advice));
+#endif
+    }
+
+private:
+#ifdef ANNY_HAS_MMAP
+    static int to_native(Advice advice)
+    {
+        switch (advice)
+        {
+        case Advice::SEQUENTIAL: return MADV_SEQUENTIAL;
+        case Advice::RANDOM: return MADV_RANDOM;
+        case Advice::WILLNEED: return MADV_WILLNEED;
+        case Advice::DONTNEED: return MADV_DONTNEED;
+        default: return MADV_NORMAL;
+        }
+    }
+#endif
+
+    void unmap() noexcept
+    {
+#ifdef ANNY_HAS_MMAP
+        if (m_data)
+            ::munmap(m_data, m_size);
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    void swap(MappedFile& other) noexcept
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+    }
+
+private:
+    char* m_data{ nullptr };
+    size_t m_size{ 0 };
+};
+
+}
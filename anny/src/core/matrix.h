@@ -1,6 +1,10 @@
 #pragma once
 
 #include <array>
+#include <cassert>
+#include <memory>
+#include <new>
+#include <type_traits>
 #include <vector>
 #include <algorithm>
 #include <numeric>
@@ -136,15 +140,19 @@ public:
 
     MatrixStorageContiguous(const std::vector<DType>& data, size_t cols)
         : m_data(data)
-        , m_rows(data.size())
+        , m_rows(cols ? data.size() / cols : 0)
         , m_cols(cols)
-    {}
+    {
+        assert(m_rows * m_cols == m_data.size());
+    }
 
     MatrixStorageContiguous(std::vector<DType>&& data, size_t cols)
         : m_data(std::move(data))
-        , m_rows(data.size())
+        , m_rows(cols ? m_data.size() / cols : 0)
         , m_cols(cols)
-    {}
+    {
+        assert(m_rows * m_cols == m_data.size());
+    }
 
     Shape shape() const { return { m_rows, m_cols }; }
 
@@ -156,14 +164,18 @@ public:
 
     size_t num_rows() const { return m_rows; }
     size_t num_cols() const { return m_cols; }
+    size_t row_stride() const { return m_cols; }
+
+    DType* data() { return m_data.data(); }
+    const DType* data() const { return m_data.data(); }
 
 private:
     inline size_t pos(size_t row, size_t col) const noexcept { return row * m_cols + col; }
 
 private:
     std::vector<DType> m_data;
-    size_t m_rows;
-    size_t m_cols;
+    size_t m_rows{ 0 };
+    size_t m_cols{ 0 };
 };
 
 
@@ -187,6 +199,319 @@ bool operator!=(const MatrixStorageContiguous<T>& left, const MatrixStorageConti
 }
 
 
+/*
+    MatrixStorageAligned - one block of memory like MatrixStorageContiguous, but every row starts at a
+    64-byte (cache line) boundary: row stride is the number of columns rounded up to ROW_ALIGNMENT bytes,
+    the padding is filled with zeros. A row never straddles an extra cache line, and SIMD kernels may process
+    the whole padded stride without tail loops (zeros don't change L1, L2, L-inf, Hamming distances and dot products).
+    operator[] still returns views of num_cols() elements.
+*/
+template <typename DType>
+class MatrixStorageAligned
+{
+public:
+    static constexpr size_t ROW_ALIGNMENT = 64;  // bytes: cache line and AVX-512 register width
+
+    MatrixStorageAligned() = default;
+    MatrixStorageAligned(MatrixStorageAligned&&) = default;
+    MatrixStorageAligned& operator=(MatrixStorageAligned&&) = default;
+
+    MatrixStorageAligned(const MatrixStorageAligned& other)
+        : MatrixStorageAligned(other.m_rows, other.m_cols)
+    {
+        std::copy(other.m_data.get(), other.m_data.get() + m_rows * m_stride, m_data.get());
+    }
+
+    MatrixStorageAligned& operator=(const MatrixStorageAligned& other)
+    {
+        if (this != &other)
+            *this = MatrixStorageAligned(other);
+        return *this;
+    }
+
+    MatrixStorageAligned(size_t rows, size_t cols)
+        : m_data(allocate(rows * padded_size(cols)))
+        , m_rows{ rows }
+        , m_cols{ cols }
+        , m_stride{ padded_size(cols) }
+    {}
+
+    MatrixStorageAligned(std::initializer_list<std::initializer_list<DType>> lst)
+        : MatrixStorageAligned(lst.size(), lst.size() ? lst.begin()->size() : 0)
+    {
+        size_t i = 0;
+        for (const auto& row : lst)
+        {
+            assert(row.size() == m_cols);
+            std::copy(row.begin(), row.end(), row_ptr(i++));
+        }
+    }
+
+    // copy ctor from data stored in STL container
+    MatrixStorageAligned(const std::vector<std::vector<DType>>& data)
+        : MatrixStorageAligned(data.size(), data.empty() ? 0 : data[0].size())
+    {
+        for (size_t i = 0; i < m_rows; i++)
+        {
+            assert(data[i].size() == m_cols);
+            std::copy(data[i].begin(), data[i].end(), row_ptr(i));
+        }
+    }
+
+    Shape shape() const { return { m_rows, m_cols }; }
+
+    VecView<DType> operator[](size_t row) { return VecView<DType>(row_ptr(row), m_cols); }
+    VecView<const DType> operator[](size_t row) const { return VecView<const DType>(row_ptr(row), m_cols); }
+
+    DType& operator()(size_t row, size_t col) { return row_ptr(row)[col]; }
+    const DType& operator()(size_t row, size_t col) const { return row_ptr(row)[col]; }
+
+    size_t num_rows() const { return m_rows; }
+    size_t num_cols() const { return m_cols; }
+    size_t row_stride() const { return m_stride; }  // distance between starts of adjacent rows, in elements
+    size_t padded_stride() const { return m_stride; }  // elements of a row kernels may process, the padding is zeros
+
+    DType* data() { return m_data.get(); }
+    const DType* data() const { return m_data.get(); }
+
+    // number of elements in a row padded to ROW_ALIGNMENT bytes
+    static size_t padded_size(size_t cols)
+    {
+        constexpr size_t lanes = (ROW_ALIGNMENT % sizeof(DType) == 0) ? ROW_ALIGNMENT / sizeof(DType) : 1;
+        return (cols + lanes - 1) / lanes * lanes;
+    }
+
+private:
+    struct AlignedDeleter
+    {
+        void operator()(DType* p) const { ::operator delete[](p, std::align_val_t{ ROW_ALIGNMENT }); }
+    };
+    using Buffer = std::unique_ptr<DType[], AlignedDeleter>;
+
+    static Buffer allocate(size_t size)
+    {
+        if (size == 0)
+            return Buffer();
+        static_assert(std::is_trivially_copyable_v<DType>);
+        auto p = static_cast<DType*>(::operator new[](size * sizeof(DType), std::align_val_t{ ROW_ALIGNMENT }));
+        std::fill(p, p + size, DType{ 0 });
+        return Buffer(p);
+    }
+
+    DType* row_ptr(size_t row) { return m_data.get() + row * m_stride; }
+    const DType* row_ptr(size_t row) const { return m_data.get() + row * m_stride; }
+
+private:
+    Buffer m_data;
+    size_t m_rows{ 0 };
+    size_t m_cols{ 0 };
+    size_t m_stride{ 0 };
+};
+
+
+template <typename T>
+bool operator==(const MatrixStorageAligned<T>& left, const MatrixStorageAligned<T>& right)
+{
+    if (left.shape() != right.shape())
+        return false;
+    for (size_t i = 0; i < left.num_rows(); i++)
+    {
+        if (left[i] != right[i])
+            return false;
+    }
+    return true;
+}
+
+template <typename T>
+bool operator!=(const MatrixStorageAligned<T>& left, const MatrixStorageAligned<T>& right)
+{
+    return !(left == right);
+}
+
+
+// true for storages with padded_stride(): number of elements of a row (padding included) kernels may process
+template <typename Storage, typename = void>
+struct has_padded_stride : std::false_type {};
+
+template <typename Storage>
+struct has_padded_stride<Storage, std::void_t<decltype(std::declval<const Storage&>().padded_stride())>> : std::true_type {};
+
+
+/*
+    MatrixStorageView - rows of a matrix kept in memory of someone else, addressed by a pointer and a row stride.
+    The memory is either
+        - borrowed: a raw pointer from the caller, who keeps it alive and unchanged while the storage is used;
+        - adopted: another storage with data() and row_stride() (contiguous, aligned, memory-mapped) moved inside,
+          or a part of memory of a shared owner (e.g. a mapped index file), it lives as long as any copy of the view (shared ownership).
+    Either way nothing is copied, so indices built on a view don't hold a second copy of the dataset.
+    Copies of a view share the same memory, use clone() for a deep copy.
+    Padding of rows (row_stride > num_cols) of borrowed memory may hold anything (e.g. other columns of a wider array),
+    distances are computed over num_cols elements then. Padding of adopted storages and of shared owners is zeros,
+    so distances are computed over the whole padded_stride() like in MatrixStorageAligned.
+*/
+template <typename DType>
+class MatrixStorageView
+{
+public:
+    MatrixStorageView() = default;
+
+    // borrowed memory, stride 0 means rows are packed (stride == cols)
+    MatrixStorageView(const DType* data, size_t rows, size_t cols, size_t stride = 0)
+        : m_data(const_cast<DType*>(data))
+        , m_rows{ rows }
+        , m_cols{ cols }
+        , m_stride{ stride ? stride : cols }
+        , m_paddedStride{ cols }
+        , m_capacity{ rows }
+    {
+        assert(m_stride >= m_cols);
+    }
+
+    // memory of owner (e.g. a mapped file), kept alive by the storage and its copies, padding of rows must be zeros
+    MatrixStorageView(std::shared_ptr<void> owner, DType* data, size_t rows, size_t cols, size_t stride)
+        : m_owner(std::move(owner))
+        , m_data(data)
+        , m_rows{ rows }
+        , m_cols{ cols }
+        , m_stride{ stride }
+        , m_paddedStride{ stride }
+        , m_capacity{ rows }
+        , m_ownsAligned{ false }
+    {
+        assert(m_owner != nullptr && m_stride >= m_cols);
+    }
+
+    // new zero-filled matrix in own aligned memory
+    MatrixStorageView(size_t rows, size_t cols)
+        : MatrixStorageView(MatrixStorageAligned<DType>(rows, cols))
+    {}
+
+    // adopts storage moved in
+    template <typename Storage, typename = std::enable_if_t<!std::is_lvalue_reference_v<Storage> &&
+        !std::is_same_v<std::decay_t<Storage>, MatrixStorageView>>>
+    explicit MatrixStorageView(Storage&& storage)
+    {
+        auto owner = std::make_shared<std::decay_t<Storage>>(std::move(storage));
+        m_data = owner->data();
+        m_rows = owner->num_rows();
+        m_cols = m_rows ? owner->num_cols() : 0;
+        m_stride = owner->row_stride();
+        if constexpr (has_padded_stride<std::decay_t<Storage>>::value)
+            m_paddedStride = owner->padded_stride();
+        else
+            m_paddedStride = m_cols;
+        m_capacity = m_rows;
+        m_owner = std::move(owner);
+        m_ownsAligned = std::is_same_v<std::decay_t<Storage>, MatrixStorageAligned<DType>>;
+    }
+
+    Shape shape() const { return { m_rows, m_cols }; }
+
+    VecView<DType> operator[](size_t row) { return VecView<DType>(row_ptr(row), m_cols); }
+    VecView<const DType> operator[](size_t row) const { return VecView<const DType>(row_ptr(row), m_cols); }
+
+    DType& operator()(size_t row, size_t col) { return row_ptr(row)[col]; }
+    const DType& operator()(size_t row, size_t col) const { return row_ptr(row)[col]; }
+
+    size_t num_rows() const { return m_rows; }
+    size_t num_cols() const { return m_cols; }
+    size_t row_stride() const { return m_stride; }
+    size_t padded_stride() const { return m_paddedStride; }  // elements of a row kernels may process: num_cols or the zero padded stride
+
+    DType* data() { return m_data; }
+    const DType* data() const { return m_data; }
+
+    // false for borrowed memory: it must not be modified
+    bool owns_data() const { return m_owner != nullptr; }
+
+    // true if rows are in own aligned memory seen by nobody else (not borrowed, shared or mapped), so they may be modified in place
+    bool owns_exclusively() const { return m_ownsAligned && m_owner.use_count() == 1; }
+
+    // rows that fit into own memory without reallocation
+    size_t capacity() const { return m_capacity; }
+
+    // moves rows into new own aligned memory for capacity rows, if there is less room (or memory is borrowed or shared)
+    void reserve(size_t capacity)
+    {
+        if (can_grow_in_place() && capacity <= m_capacity)
+            return;
+
+        capacity = std::max(capacity, m_rows);
+        auto owner = std::make_shared<MatrixStorageAligned<DType>>(capacity, m_cols);
+        for (size_t i = 0; i < m_rows; i++)
+            std::copy(row_ptr(i), row_ptr(i) + m_cols, (*owner)[i].begin());
+        m_data = owner->data();
+        m_stride = owner->row_stride();
+        m_paddedStride = owner->padded_stride();
+        m_capacity = capacity;
+        m_owner = std::move(owner);
+        m_ownsAligned = true;
+    }
+
+    /*
+        Appends a row, capacity doubles when it is exhausted. Empty storage takes number of columns from the first row.
+        Copies of the storage share the memory, so appending to a shared (or borrowed) storage moves it to new memory first.
+    */
+    void push_back(VecView<const DType> row)
+    {
+        if (m_rows == 0 && m_cols != row.size())
+        {
+            m_cols = row.size();
+            m_owner.reset();  // memory reserved for other number of columns is useless
+        }
+        assert(row.size() == m_cols);
+        if (!can_grow_in_place() || m_rows == m_capacity)
+            reserve(std::max<size_t>({ m_capacity, 2 * m_rows, 1 }));
+        std::copy(row.begin(), row.end(), row_ptr(m_rows));
+        m_rows++;
+    }
+
+    // deep copy into own aligned memory
+    MatrixStorageView clone() const
+    {
+        MatrixStorageAligned<DType> copy(m_rows, m_cols);
+        for (size_t i = 0; i < m_rows; i++)
+            std::copy(row_ptr(i), row_ptr(i) + m_cols, copy[i].begin());
+        return MatrixStorageView(std::move(copy));
+    }
+
+private:
+    DType* row_ptr(size_t row) { return m_data + row * m_stride; }
+    const DType* row_ptr(size_t row) const { return m_data + row * m_stride; }
+
+    bool can_grow_in_place() const { return owns_exclusively(); }
+
+private:
+    std::shared_ptr<void> m_owner;
+    DType* m_data{ nullptr };
+    size_t m_rows{ 0 };
+    size_t m_cols{ 0 };
+    size_t m_stride{ 0 };
+    size_t m_paddedStride{ 0 };
+    size_t m_capacity{ 0 };  // rows allocated in own memory
+    bool m_ownsAligned{ false };  // m_owner is MatrixStorageAligned (adopted or allocated by the view)
+};
+
+
+template <typename T>
+bool operator==(const MatrixStorageView<T>& left, const MatrixStorageView<T>& right)
+{
+    if (left.shape() != right.shape())
+        return false;
+    for (size_t i = 0; i < left.num_rows(); i++)
+    {
+        if (left[i] != right[i])
+            return false;
+    }
+    return true;
+}
+
+template <typename T>
+bool operator!=(const MatrixStorageView<T>& left, const MatrixStorageView<T>& right)
+{
+    return !(left == right);
+}
+
 
 /*
     Matrix
@@ -215,6 +540,10 @@ public:
         : m_storage(storage)
     {}
 
+    Matrix(Storage&& storage)
+        : m_storage(std::move(storage))
+    {}
+
     Shape shape() const { return m_storage.shape(); }
 
     VecView<T> operator[](size_t row) { return m_storage[row]; }
@@ -226,6 +555,16 @@ public:
     size_t num_rows() const { return m_storage.num_rows(); }
     size_t num_cols() const { return m_storage.num_cols(); }
 
+    const Storage& storage() const { return m_storage; }
+
+    // appending rows, for storages supporting it (MatrixStorageView)
+    size_t capacity() const { return m_storage.capacity(); }
+    void reserve(size_t rows) { m_storage.reserve(rows); }
+    void push_back(VecView<const T> row) { m_storage.push_back(row); }
+
+    // moves the storage out (e.g. to be adopted by an index without copying), the matrix must not be used afterwards
+    Storage release() { return std::move(m_storage); }
+
     // math
 
     // operations with a number
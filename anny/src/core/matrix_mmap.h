@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "matrix.h"
+#include "mapped_file.h"
+
+
+namespace anny
+{
+
+/*
+    Binary matrix file: 64-byte header followed by rows stored one after another, every row takes row_stride elements
+    (row_stride >= cols, the rest of a row is padding filled with zeros). Data starts at data_offset (multiple of 64 bytes),
+    so with a padded stride every row of a mapped file is cache line aligned, like in MatrixStorageAligned.
+*/
+struct MatrixFileHeader
+{
+    static constexpr char MAGIC[8] = { 'A', 'N', 'N', 'Y', 'M', 'A', 'T', '\0' };
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t elem_size;  // sizeof(T)
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t row_stride;
+    uint64_t data_offset;
+    uint8_t reserved[16];
+};
+static_assert(sizeof(MatrixFileHeader) == 64);
+
+
+/*
+    MatrixStorageMmap - read-only storage over a memory-mapped binary matrix file (see MatrixFileHeader).
+    Nothing is loaded or copied: pages are read by the OS on first access and stay in the page cache,
+    so datasets larger than RAM can be scanned and queried.
+    The mapping is read-only: non-const accessors exist for the Matrix interface, but writing through them faults.
+    Access pattern hints (madvise) can be changed at any time, e.g. SEQUENTIAL for a build scan, then RANDOM for queries.
+    Available on POSIX systems only.
+*/
+template <typename DType>
+class MatrixStorageMmap
+{
+public:
+    using Advice = MappedFile::Advice;
+
+    MatrixStorageMmap() = default;
+    MatrixStorageMmap(const MatrixStorageMmap&) = delete;
+    MatrixStorageMmap& operator=(const MatrixStorageMmap&) = delete;
+
+    MatrixStorageMmap(MatrixStorageMmap&& other) noexcept
+    {
+        swap(other);
+    }
+
+    MatrixStorageMmap& operator=(MatrixStorageMmap&& other) noexcept
+    {
+        MatrixStorageMmap tmp(std::move(other));
+        swap(tmp);
+        return *this;
+    }
+
+    explicit MatrixStorageMmap(const std::string& path, Advice advice = Advice::NORMAL)
+        : m_file(path)
+    {
+        if (m_file.size() < sizeof(MatrixFileHeader))
+            throw std::runtime_error("Bad matrix file (too short): " + path);
+
+        MatrixFileHeader header;
+        std::memcpy(&header, m_file.data(), sizeof(header));
+        const char* error = validate(header, m_file.size());
+        if (error)
+            throw std::runtime_error(std::string("Bad matrix file (") + error + "): " + path);
+
+        m_data = reinterpret_cast<DType*>(m_file.data() + header.data_offset);
+        m_rows = header.rows;
+        m_cols = header.cols;
+        m_stride = header.row_stride;
+        advise(advice);
+    }
+
+    Shape shape() const { return { m_rows, m_cols }; }
+
+    VecView<DType> operator[](size_t row) { return VecView<DType>(row_ptr(row), m_cols); }
+    VecView<const DType> operator[](size_t row) const { return VecView<const DType>(row_ptr(row), m_cols); }
+
+    DType& operator()(size_t row, size_t col) { return row_ptr(row)[col]; }
+    const DType& operator()(size_t row, size_t col) const { return row_ptr(row)[col]; }
+
+    size_t num_rows() const { return m_rows; }
+    size_t num_cols() const { return m_cols; }
+    size_t row_stride() const { return m_stride; }
+    size_t padded_stride() const { return m_stride; }  // padding of matrix files is zeros (see write())
+
+    DType* data() { return m_data; }
+    const DType* data() const { return m_data; }
+
+    // hint the OS about the expected access to rows [first_row, last_row), by default to all rows
+    void advise(Advice advice, size_t first_row = 0, size_t last_row = static_cast<size_t>(-1)) const
+    {
+        last_row = std::min(last_row, m_rows);
+        if (first_row >= last_row)
+            return;
+
+        const char* first = reinterpret_cast<const char*>(row_ptr(first_row));
+        const char* last = reinterpret_cast<const char*>(row_ptr(last_row - 1) + m_cols);
+        m_file.advise(advice, static_cast<size_t>(first - m_file.data()), static_cast<size_t>(last - first));
+    }
+
+    /*
+        Writes matrix into a binary file readable by MatrixStorageMmap.
+        With pad_rows the row stride is padded to 64 bytes like in MatrixStorageAligned, so mapped rows are cache line aligned.
+    */
+    template <typename Storage>
+    static void write(const std::string& path, const Matrix<DType, Storage>& matrix, bool pad_rows = true)
+    {
+        const size_t rows = matrix.num_rows();
+        const size_t cols = rows ? matrix.num_cols() : 0;
+        const size_t stride = pad_rows ? MatrixStorageAligned<DType>::padded_size(cols) : cols;
+
+        MatrixFileHeader header{};
+        std::memcpy(header.magic, MatrixFileHeader::MAGIC, sizeof(header.magic));
+        header.version = MatrixFileHeader::VERSION;
+        header.elem_size = sizeof(DType);
+        header.rows = rows;
+        header.cols = cols;
+        header.row_stride = stride;
+        header.data_offset = sizeof(MatrixFileHeader);
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+            throw std::runtime_error("Failed to open matrix file for writing: " + path);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        std::vector<DType> row_buffer(stride, DType{ 0 });
+        for (size_t i = 0; i < rows; i++)
+        {
+            auto row = matrix[i];
+            std::copy(row.begin(), row.end(), row_buffer.begin());
+            out.write(reinterpret_cast<const char*>(row_buffer.data()), stride * sizeof(DType));
+        }
+        if (!out)
+            throw std::runtime_error("Failed to write matrix file: " + path);
+    }
+
+private:
+    static const char* validate(const MatrixFileHeader& header, size_t file_size)
+    {
+        if (std::memcmp(header.magic, MatrixFileHeader::MAGIC, sizeof(header.magic)) != 0)
+            return "wrong magic";
+        if (header.version != MatrixFileHeader::VERSION)
+            return "unsupported version";
+        if (header.elem_size != sizeof(DType))
+            return "element type size mismatch";
+        if (header.row_stride < header.cols)
+            return "row stride is less than number of columns";
+        if (header.data_offset < sizeof(MatrixFileHeader) || header.data_offset > file_size || header.data_offset % MatrixStorageAligned<DType>::ROW_ALIGNMENT != 0)
+            return "bad data offset";
+        if (header.rows > 0 && header.cols == 0)
+            return "rows have no columns";
+        if (header.rows > 0 && (header.row_stride > (file_size - header.data_offset) / sizeof(DType) / header.rows))
+            return "file is truncated";
+        return nullptr;
+    }
+
+    void swap(MatrixStorageMmap& other) noexcept
+    {
+        std::swap(m_file, other.m_file);
+        std::swap(m_data, other.m_data);
+        std::swap(m_rows, other.m_rows);
+        std::swap(m_cols, other.m_cols);
+        std::swap(m_stride, other.m_stride);
+    }
+
+    DType* row_ptr(size_t row) { return m_data + row * m_stride; }
+    const DType* row_ptr(size_t row) const { return m_data + row * m_stride; }
+
+private:
+    MappedFile m_file;
+    DType* m_data{ nullptr };
+    size_t m_rows{ 0 };
+    size_t m_cols{ 0 };
+    size_t m_stride{ 0 };
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include "vec.h"
+#include "vec_view.h"
+#include "matrix.h"
+#include "distance.h"
+
+
+namespace anny
+{
+	/*
+	* MipsTransform reduces Maximum Inner Product Search to L2 nearest neighbors search (Bachrach et al., 2014).
+	* Every data point x is augmented with one more coordinate sqrt(M^2 - |x|^2), where M is the max L2 norm over dataset,
+	* and every query q is augmented with 0. Then
+	*     |q' - x'|^2 = |q|^2 + M^2 - 2 * dot(q, x),
+	* so for a given query, L2 order of augmented points is the same as inner product order of original points.
+	* This lets space partitioning indices (KDTree, Annoy) split and prune in L2 space and stay correct for MIPS.
+	* Note that dot(q', x') = dot(q, x), so inner product distance can be calculated on augmented vectors as well.
+	*/
+
+	template <typename T>
+	class MipsTransform
+	{
+	public:
+		MipsTransform() = default;
+
+		template <typename Storage>
+		Matrix<T, Storage> fit_transform(const Matrix<T, Storage>& data)
+		{
+			const size_t rows = data.num_rows();
+			const size_t cols = data.num_cols();
+
+			std::vector<T> norms_squared(rows);
+			m_maxNormSquared = T{ 0 };  // stays 0 for empty data
+			for (size_t i = 0; i < rows; i++)
+			{
+				norms_squared[i] = anny::l2_norm_squared(data[i]);
+				m_maxNormSquared = std::max(m_maxNormSquared, norms_squared[i]);
+			}
+
+			Matrix<T, Storage> result(rows, cols + 1);
+			for (size_t i = 0; i < rows; i++)
+			{
+				auto row = data[i];
+				std::copy(row.begin(), row.end(), result[i].begin());
+				result(i, cols) = std::sqrt(std::max(T{ 0 }, m_maxNormSquared - norms_squared[i]));
+			}
+			return result;
+		}
+
+		Vec<T> transform_query(VecView<const T> q) const
+		{
+			Vec<T> result(q.size() + 1, T{ 0 });
+			std::copy(q.cbegin(), q.cend(), result.view().begin());
+			return result;
+		}
+
+		Vec<T> transform_query(const std::vector<T>& q) const
+		{
+			return transform_query(VecView<const T>(q.data(), q.size()));
+		}
+
+		// convert inner product distance (1 - dot) of a query to squared L2 distance between augmented vectors
+		T to_l2_squared(T ip_distance, T query_norm_squared) const
+		{
+			return query_norm_squared + m_maxNormSquared - T{ 2 } * (T{ 1 } - ip_distance);
+		}
+
+		// convert squared L2 distance between augmented vectors back to inner product distance (1 - dot)
+		T from_l2_squared(T l2_squared, T query_norm_squared) const
+		{
+			return T{ 1 } - (query_norm_squared + m_maxNormSquared - l2_squared) / T{ 2 };
+		}
+
+		T max_norm_squared() const noexcept { return m_maxNormSquared; }
+
+	private:
+		T m_maxNormSquared{ 0 };
+	};
+
+}
\ No newline at end of file
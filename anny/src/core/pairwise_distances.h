@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include "matrix.h"
+#include "distance.h"
+#include "gemm.h"
+#include "../utils/thread_pool.h"
+
+
+namespace anny
+{
+
+/*
+	Many-to-many distances between every row of Q (queries) and every row of X (dataset), result is a Q.rows x X.rows matrix.
+	Instead of Q.rows * X.rows separate distance calls all dot products are computed at once by a blocked
+	matrix multiplication Q * X^T, then:
+		squared L2:  |q - x|^2 = |q|^2 + |x|^2 - 2 q.x  (row norms are computed once per call, O((Q.rows + X.rows) * cols))
+		L2:          sqrt of the above
+		cosine, inner product:  1 - q.x  (like CosineDistance, vectors are expected to be normalized)
+	Rows of Q are split between num_threads threads (0 - use all hardware threads).
+	If the library is built with BLAS (ANNY_USE_BLAS), the multiplication is done by one BLAS call, which uses its own threads.
+	Squared L2 computed this way loses precision for very close points (catastrophic cancellation), so it is clamped at 0.
+*/
+template <typename Dist = L2Distance, typename T>
+Matrix<T> pairwise_distances(const Matrix<T>& Q, const Matrix<T>& X, size_t num_threads = 0)
+{
+	static_assert(std::is_floating_point_v<T>, "pairwise_distances is implemented for floating point types only");
+	constexpr DistanceId id = Dist::id;
+	static_assert(id == DistanceId::L2 || id == DistanceId::L2_SQUARED || id == DistanceId::COSINE || id == DistanceId::INNER_PRODUCT,
+		"pairwise_distances supports L2, squared L2, cosine and inner product distances only");
+
+	const size_t M = Q.num_rows();
+	const size_t N = X.num_rows();
+	if (M == 0 || N == 0)
+		return Matrix<T>(M, N);
+
+	const size_t K = Q.num_cols();
+	assert(K == X.num_cols());
+
+	Matrix<T> D(M, N);
+	const T* q_data = Q[0].cbegin();
+	const T* x_data = X[0].cbegin();
+	T* d_data = D[0].begin();
+
+	constexpr bool IS_L2 = (id == DistanceId::L2 || id == DistanceId::L2_SQUARED);
+	auto row_norms_squared = [](const Matrix<T>& A) {
+		std::vector<T> norms(A.num_rows());
+		for (size_t i = 0; i < A.num_rows(); i++)
+			norms[i] = A[i].dot(A[i]);
+		return norms;
+	};
+	std::vector<T> q_norms;
+	std::vector<T> x_norms;
+	if constexpr (IS_L2)
+	{
+		q_norms = row_norms_squared(Q);
+		x_norms = row_norms_squared(X);
+	}
+
+	auto process_rows = [&](size_t first, size_t last) {
+		gemm::gemm_nt(last - first, N, K, q_data + first * K, K, x_data, K, d_data + first * N, N);
+		for (size_t i = first; i < last; i++)
+		{
+			T* row = d_data + i * N;
+			for (size_t j = 0; j < N; j++)
+			{
+				if constexpr (IS_L2)
+				{
+					T d = std::max(T{ 0 }, q_norms[i] + x_norms[j] - T{ 2 } * row[j]);
+					row[j] = (id == DistanceId::L2) ? std::sqrt(d) : d;
+				}
+				else
+				{
+					row[j] = T{ 1 } - row[j];
+				}
+			}
+		}
+	};
+
+	num_threads = (num_threads == 0) ? utils::default_num_threads() : num_threads;
+	if (gemm::uses_blas<T>() || num_threads == 1)
+	{
+		process_rows(0, M);
+	}
+	else
+	{
+		utils::ThreadPool pool(num_threads);
+		pool.parallel_for(0, M, process_rows, /*min_chunk*/ gemm::MC);
+	}
+
+	return D;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,1152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+
+// SIMD kernels are implemented with x86 intrinsics and per-function target attributes (GCC/Clang),
+// so the library stays header-only and does not require -mavx2 or similar flags from the user.
+// Everything else (MSVC, ARM, or ANNY_DISABLE_SIMD defined) falls back to scalar loops.
+#if !defined(ANNY_DISABLE_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ANNY_SIMD_X86 1
+#include <immintrin.h>
+#define ANNY_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+
+namespace anny
+{
+namespace simd
+{
+
+enum class InstructionSet: int
+{
+	SCALAR = 0,
+	SSE,
+	AVX2,
+	AVX512
+};
+
+
+/*
+	Kernels - table of distance kernels for raw arrays of type T, selected once for the given instruction set.
+*/
+template <typename T>
+struct Kernels
+{
+	using func_t = T(*)(const T* a, const T* b, size_t n);
+	using func_x4_t = void(*)(const T* q, const T* const* rows, size_t n, T* out);  // q against rows[0..3]
+
+	func_t l2_squared{ nullptr };
+	func_t dot{ nullptr };
+	func_t l1{ nullptr };
+	func_t linf{ nullptr };
+	func_x4_t l2_squared_x4{ nullptr };
+	func_x4_t dot_x4{ nullptr };
+};
+
+
+namespace detail
+{
+	template <typename T>
+	T l2_squared_scalar(const T* a, const T* b, size_t n)
+	{
+		T d{ 0 };
+		for (size_t i = 0; i < n; i++)
+		{
+			T sub = a[i] - b[i];
+			d += sub * sub;
+		}
+		return d;
+	}
+
+	template <typename T>
+	T dot_scalar(const T* a, const T* b, size_t n)
+	{
+		T d{ 0 };
+		for (size_t i = 0; i < n; i++)
+		{
+			d += a[i] * b[i];
+		}
+		return d;
+	}
+
+	template <typename T>
+	inline T abs_diff(T a, T b)
+	{
+		if constexpr (std::is_floating_point_v<T>)
+			return std::fabs(a - b);  // branchless
+		else
+			return (a > b) ? a - b : b - a;  // safe for unsigned types too
+	}
+
+	template <typename T>
+	T l1_scalar(const T* a, const T* b, size_t n)
+	{
+		T d{ 0 };
+		for (size_t i = 0; i < n; i++)
+		{
+			d += abs_diff(a[i], b[i]);
+		}
+		return d;
+	}
+
+	template <typename T>
+	T linf_scalar(const T* a, const T* b, size_t n)
+	{
+		T d{ 0 };
+		for (size_t i = 0; i < n; i++)
+		{
+			T sub = abs_diff(a[i], b[i]);
+			d = (sub > d) ? sub : d;
+		}
+		return d;
+	}
+
+	inline uint64_t popcount64(uint64_t x)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return static_cast<uint64_t>(__builtin_popcountll(x));
+#else
+		x = x - ((x >> 1) & 0x5555555555555555ULL);
+		x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+		x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		return (x * 0x0101010101010101ULL) >> 56;
+#endif
+	}
+
+	template <typename T>
+	void l2_squared_x4_scalar(const T* q, const T* const* rows, size_t n, T* out)
+	{
+		T d0{ 0 }, d1{ 0 }, d2{ 0 }, d3{ 0 };
+		for (size_t i = 0; i < n; i++)
+		{
+			T s0 = q[i] - rows[0][i];
+			T s1 = q[i] - rows[1][i];
+			T s2 = q[i] - rows[2][i];
+			T s3 = q[i] - rows[3][i];
+			d0 += s0 * s0;
+			d1 += s1 * s1;
+			d2 += s2 * s2;
+			d3 += s3 * s3;
+		}
+		out[0] = d0; out[1] = d1; out[2] = d2; out[3] = d3;
+	}
+
+	template <typename T>
+	void dot_x4_scalar(const T* q, const T* const* rows, size_t n, T* out)
+	{
+		T d0{ 0 }, d1{ 0 }, d2{ 0 }, d3{ 0 };
+		for (size_t i = 0; i < n; i++)
+		{
+			d0 += q[i] * rows[0][i];
+			d1 += q[i] * rows[1][i];
+			d2 += q[i] * rows[2][i];
+			d3 += q[i] * rows[3][i];
+		}
+		out[0] = d0; out[1] = d1; out[2] = d2; out[3] = d3;
+	}
+
+	// x4 kernel made of 4 calls of a single-row kernel, for instruction sets without a blocked version
+	template <typename T, T(*Kernel)(const T*, const T*, size_t)>
+	void x4_by_rows(const T* q, const T* const* rows, size_t n, T* out)
+	{
+		for (size_t r = 0; r < 4; r++)
+			out[r] = Kernel(q, rows[r], n);
+	}
+
+	inline uint64_t hamming_scalar(const uint64_t* a, const uint64_t* b, size_t n)
+	{
+		uint64_t d{ 0 };
+		for (size_t i = 0; i < n; i++)
+		{
+			d += popcount64(a[i] ^ b[i]);
+		}
+		return d;
+	}
+
+#ifdef ANNY_SIMD_X86
+
+	// SSE2 (4 floats / 2 doubles per register)
+
+	ANNY_TARGET("sse2")
+	inline float hsum_sse(__m128 v)
+	{
+		__m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 sums = _mm_add_ps(v, shuf);
+		shuf = _mm_movehl_ps(shuf, sums);
+		sums = _mm_add_ss(sums, shuf);
+		return _mm_cvtss_f32(sums);
+	}
+
+	ANNY_TARGET("sse2")
+	inline double hsum_sse(__m128d v)
+	{
+		__m128d high = _mm_unpackhi_pd(v, v);
+		return _mm_cvtsd_f64(_mm_add_sd(v, high));
+	}
+
+	ANNY_TARGET("sse2")
+	inline float l2_squared_sse(const float* a, const float* b, size_t n)
+	{
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+			__m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+		}
+		float d = hsum_sse(_mm_add_ps(acc0, acc1));
+		for (; i < n; i++)
+		{
+			float sub = a[i] - b[i];
+			d += sub * sub;
+		}
+		return d;
+	}
+
+	ANNY_TARGET("sse2")
+	inline double l2_squared_sse(const double* a, const double* b, size_t n)
+	{
+		__m128d acc0 = _mm_setzero_pd();
+		__m128d acc1 = _mm_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128d d0 = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+			__m128d d1 = _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2));
+			acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+			acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+		}
+		double d = hsum_sse(_mm_add_pd(acc0, acc1));
+		for (; i < n; i++)
+		{
+			double sub = a[i] - b[i];
+			d += sub * sub;
+		}
+		return d;
+	}
+
+	ANNY_TARGET("sse2")
+	inline float dot_sse(const float* a, const float* b, size_t n)
+	{
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+		}
+		float d = hsum_sse(_mm_add_ps(acc0, acc1));
+		for (; i < n; i++)
+		{
+			d += a[i] * b[i];
+		}
+		return d;
+	}
+
+	ANNY_TARGET("sse2")
+	inline double dot_sse(const double* a, const double* b, size_t n)
+	{
+		__m128d acc0 = _mm_setzero_pd();
+		__m128d acc1 = _mm_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+			acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+		}
+		double d = hsum_sse(_mm_add_pd(acc0, acc1));
+		for (; i < n; i++)
+		{
+			d += a[i] * b[i];
+		}
+		return d;
+	}
+
+	ANNY_TARGET("sse2")
+	inline float hmax_sse(__m128 v)
+	{
+		__m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 maxs = _mm_max_ps(v, shuf);
+		shuf = _mm_movehl_ps(shuf, maxs);
+		maxs = _mm_max_ss(maxs, shuf);
+		return _mm_cvtss_f32(maxs);
+	}
+
+	ANNY_TARGET("sse2")
+	inline double hmax_sse(__m128d v)
+	{
+		__m128d high = _mm_unpackhi_pd(v, v);
+		return _mm_cvtsd_f64(_mm_max_sd(v, high));
+	}
+
+	ANNY_TARGET("sse2")
+	inline float l1_sse(const float* a, const float* b, size_t n)
+	{
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		__m128 acc = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+			acc = _mm_add_ps(acc, _mm_andnot_ps(sign, d));
+		}
+		float d = hsum_sse(acc);
+		for (; i < n; i++)
+		{
+			d += std::fabs(a[i] - b[i]);
+		}
+		return d;
+	}
+
+	ANNY_TARGET("sse2")
+	inline double l1_sse(const double* a, const double* b, size_t n)
+	{
+		const __m128d sign = _mm_set1_pd(-0.0);
+		__m128d acc = _mm_setzero_pd();
+		size_t i = 0;
+		for (; i + 2 <= n; i += 2)
+		{
+			__m128d d = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+			acc = _mm_add_pd(acc, _mm_andnot_pd(sign, d));
+		}
+		double d = hsum_sse(acc);
+		for (; i < n; i++)
+		{
+			d += std::fabs(a[i] - b[i]);
+		}
+		return d;
+	}
+
+	ANNY_TARGET("sse2")
+	inline float linf_sse(const float* a, const float* b, size_t n)
+	{
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		__m128 acc = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+			acc = _mm_max_ps(acc, _mm_andnot_ps(sign, d));
+		}
+		float d = hmax_sse(acc);
+		for (; i < n; i++)
+		{
+			d = std::fmax(d, std::fabs(a[i] - b[i]));
+		}
+		return d;
+	}
+
+	ANNY_TARGET("sse2")
+	inline double linf_sse(const double* a, const double* b, size_t n)
+	{
+		const __m128d sign = _mm_set1_pd(-0.0);
+		__m128d acc = _mm_setzero_pd();
+		size_t i = 0;
+		for (; i + 2 <= n; i += 2)
+		{
+			__m128d d = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+			acc = _mm_max_pd(acc, _mm_andnot_pd(sign, d));
+		}
+		double d = hmax_sse(acc);
+		for (; i < n; i++)
+		{
+			d = std::fmax(d, std::fabs(a[i] - b[i]));
+		}
+		return d;
+	}
+
+	// AVX2 + FMA (8 floats / 4 doubles per register)
+
+	ANNY_TARGET("avx2,fma")
+	inline float hsum_avx(__m256 v)
+	{
+		__m128 low = _mm256_castps256_ps128(v);
+		__m128 high = _mm256_extractf128_ps(v, 1);
+		return hsum_sse(_mm_add_ps(low, high));
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline double hsum_avx(__m256d v)
+	{
+		__m128d low = _mm256_castpd256_pd128(v);
+		__m128d high = _mm256_extractf128_pd(v, 1);
+		return hsum_sse(_mm_add_pd(low, high));
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline float l2_squared_avx2(const float* a, const float* b, size_t n)
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			__m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+			__m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+			acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+		}
+		if (i + 8 <= n)
+		{
+			__m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+			acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+			i += 8;
+		}
+		float d = hsum_avx(_mm256_add_ps(acc0, acc1));
+		for (; i < n; i++)
+		{
+			float sub = a[i] - b[i];
+			d += sub * sub;
+		}
+		return d;
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline double l2_squared_avx2(const double* a, const double* b, size_t n)
+	{
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+			__m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4));
+			acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+			acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+		}
+		if (i + 4 <= n)
+		{
+			__m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+			acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+			i += 4;
+		}
+		double d = hsum_avx(_mm256_add_pd(acc0, acc1));
+		for (; i < n; i++)
+		{
+			double sub = a[i] - b[i];
+			d += sub * sub;
+		}
+		return d;
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline float dot_avx2(const float* a, const float* b, size_t n)
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+			acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+		}
+		if (i + 8 <= n)
+		{
+			acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+			i += 8;
+		}
+		float d = hsum_avx(_mm256_add_ps(acc0, acc1));
+		for (; i < n; i++)
+		{
+			d += a[i] * b[i];
+		}
+		return d;
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline double dot_avx2(const double* a, const double* b, size_t n)
+	{
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc0);
+			acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), acc1);
+		}
+		if (i + 4 <= n)
+		{
+			acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc0);
+			i += 4;
+		}
+		double d = hsum_avx(_mm256_add_pd(acc0, acc1));
+		for (; i < n; i++)
+		{
+			d += a[i] * b[i];
+		}
+		return d;
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline float l1_avx2(const float* a, const float* b, size_t n)
+	{
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			__m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+			__m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+			acc0 = _mm256_add_ps(acc0, _mm256_andnot_ps(sign, d0));
+			acc1 = _mm256_add_ps(acc1, _mm256_andnot_ps(sign, d1));
+		}
+		if (i + 8 <= n)
+		{
+			__m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+			acc0 = _mm256_add_ps(acc0, _mm256_andnot_ps(sign, d0));
+			i += 8;
+		}
+		float d = hsum_avx(_mm256_add_ps(acc0, acc1));
+		for (; i < n; i++)
+		{
+			d += std::fabs(a[i] - b[i]);
+		}
+		return d;
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline double l1_avx2(const double* a, const double* b, size_t n)
+	{
+		const __m256d sign = _mm256_set1_pd(-0.0);
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+			__m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4));
+			acc0 = _mm256_add_pd(acc0, _mm256_andnot_pd(sign, d0));
+			acc1 = _mm256_add_pd(acc1, _mm256_andnot_pd(sign, d1));
+		}
+		if (i + 4 <= n)
+		{
+			__m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+			acc0 = _mm256_add_pd(acc0, _mm256_andnot_pd(sign, d0));
+			i += 4;
+		}
+		double d = hsum_avx(_mm256_add_pd(acc0, acc1));
+		for (; i < n; i++)
+		{
+			d += std::fabs(a[i] - b[i]);
+		}
+		return d;
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline float linf_avx2(const float* a, const float* b, size_t n)
+	{
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		__m256 acc = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+			acc = _mm256_max_ps(acc, _mm256_andnot_ps(sign, d));
+		}
+		float d = hmax_sse(_mm_max_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+		for (; i < n; i++)
+		{
+			d = std::fmax(d, std::fabs(a[i] - b[i]));
+		}
+		return d;
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline double linf_avx2(const double* a, const double* b, size_t n)
+	{
+		const __m256d sign = _mm256_set1_pd(-0.0);
+		__m256d acc = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			__m256d d = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+			acc = _mm256_max_pd(acc, _mm256_andnot_pd(sign, d));
+		}
+		double d = hmax_sse(_mm_max_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1)));
+		for (; i < n; i++)
+		{
+			d = std::fmax(d, std::fabs(a[i] - b[i]));
+		}
+		return d;
+	}
+
+	// AVX-512F (16 floats / 8 doubles per register), tail is processed with masked loads
+
+	ANNY_TARGET("avx512f")
+	inline float l2_squared_avx512(const float* a, const float* b, size_t n)
+	{
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		size_t i = 0;
+		for (; i + 32 <= n; i += 32)
+		{
+			__m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+			__m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+			acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+		}
+		for (; i < n; i += 16)
+		{
+			__mmask16 mask = (n - i >= 16) ? __mmask16(0xFFFF) : __mmask16((1u << (n - i)) - 1);
+			__m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+			acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+		}
+		return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+	}
+
+	ANNY_TARGET("avx512f")
+	inline double l2_squared_avx512(const double* a, const double* b, size_t n)
+	{
+		__m512d acc0 = _mm512_setzero_pd();
+		__m512d acc1 = _mm512_setzero_pd();
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			__m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i));
+			__m512d d1 = _mm512_sub_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8));
+			acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+			acc1 = _mm512_fmadd_pd(d1, d1, acc1);
+		}
+		for (; i < n; i += 8)
+		{
+			__mmask8 mask = (n - i >= 8) ? __mmask8(0xFF) : __mmask8((1u << (n - i)) - 1);
+			__m512d d0 = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, a + i), _mm512_maskz_loadu_pd(mask, b + i));
+			acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+		}
+		return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+	}
+
+	ANNY_TARGET("avx512f")
+	inline float dot_avx512(const float* a, const float* b, size_t n)
+	{
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		size_t i = 0;
+		for (; i + 32 <= n; i += 32)
+		{
+			acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+			acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+		}
+		for (; i < n; i += 16)
+		{
+			__mmask16 mask = (n - i >= 16) ? __mmask16(0xFFFF) : __mmask16((1u << (n - i)) - 1);
+			acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), acc0);
+		}
+		return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+	}
+
+	ANNY_TARGET("avx512f")
+	inline double dot_avx512(const double* a, const double* b, size_t n)
+	{
+		__m512d acc0 = _mm512_setzero_pd();
+		__m512d acc1 = _mm512_setzero_pd();
+		size_t i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), acc0);
+			acc1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8), acc1);
+		}
+		for (; i < n; i += 8)
+		{
+			__mmask8 mask = (n - i >= 8) ? __mmask8(0xFF) : __mmask8((1u << (n - i)) - 1);
+			acc0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, a + i), _mm512_maskz_loadu_pd(mask, b + i), acc0);
+		}
+		return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+	}
+
+	ANNY_TARGET("avx512f")
+	inline float l1_avx512(const float* a, const float* b, size_t n)
+	{
+		__m512 acc = _mm512_setzero_ps();
+		for (size_t i = 0; i < n; i += 16)
+		{
+			__mmask16 mask = (n - i >= 16) ? __mmask16(0xFFFF) : __mmask16((1u << (n - i)) - 1);
+			__m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+			acc = _mm512_add_ps(acc, _mm512_abs_ps(d));
+		}
+		return _mm512_reduce_add_ps(acc);
+	}
+
+	ANNY_TARGET("avx512f")
+	inline double l1_avx512(const double* a, const double* b, size_t n)
+	{
+		__m512d acc = _mm512_setzero_pd();
+		for (size_t i = 0; i < n; i += 8)
+		{
+			__mmask8 mask = (n - i >= 8) ? __mmask8(0xFF) : __mmask8((1u << (n - i)) - 1);
+			__m512d d = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, a + i), _mm512_maskz_loadu_pd(mask, b + i));
+			acc = _mm512_add_pd(acc, _mm512_abs_pd(d));
+		}
+		return _mm512_reduce_add_pd(acc);
+	}
+
+	ANNY_TARGET("avx512f")
+	inline float linf_avx512(const float* a, const float* b, size_t n)
+	{
+		__m512 acc = _mm512_setzero_ps();
+		for (size_t i = 0; i < n; i += 16)
+		{
+			__mmask16 mask = (n - i >= 16) ? __mmask16(0xFFFF) : __mmask16((1u << (n - i)) - 1);
+			__m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+			acc = _mm512_max_ps(acc, _mm512_abs_ps(d));
+		}
+		return _mm512_reduce_max_ps(acc);
+	}
+
+	ANNY_TARGET("avx512f")
+	inline double linf_avx512(const double* a, const double* b, size_t n)
+	{
+		__m512d acc = _mm512_setzero_pd();
+		for (size_t i = 0; i < n; i += 8)
+		{
+			__mmask8 mask = (n - i >= 8) ? __mmask8(0xFF) : __mmask8((1u << (n - i)) - 1);
+			__m512d d = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, a + i), _mm512_maskz_loadu_pd(mask, b + i));
+			acc = _mm512_max_pd(acc, _mm512_abs_pd(d));
+		}
+		return _mm512_reduce_max_pd(acc);
+	}
+
+	// register blocking: each chunk of the query is loaded once and used for 4 rows, 4 independent accumulators
+
+	ANNY_TARGET("avx2,fma")
+	inline void l2_squared_x4_avx2(const float* q, const float* const* rows, size_t n, float* out)
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		__m256 acc2 = _mm256_setzero_ps();
+		__m256 acc3 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 vq = _mm256_loadu_ps(q + i);
+			__m256 d0 = _mm256_sub_ps(vq, _mm256_loadu_ps(rows[0] + i));
+			__m256 d1 = _mm256_sub_ps(vq, _mm256_loadu_ps(rows[1] + i));
+			__m256 d2 = _mm256_sub_ps(vq, _mm256_loadu_ps(rows[2] + i));
+			__m256 d3 = _mm256_sub_ps(vq, _mm256_loadu_ps(rows[3] + i));
+			acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+			acc2 = _mm256_fmadd_ps(d2, d2, acc2);
+			acc3 = _mm256_fmadd_ps(d3, d3, acc3);
+		}
+		out[0] = hsum_avx(acc0); out[1] = hsum_avx(acc1); out[2] = hsum_avx(acc2); out[3] = hsum_avx(acc3);
+		for (; i < n; i++)
+		{
+			for (size_t r = 0; r < 4; r++)
+			{
+				float sub = q[i] - rows[r][i];
+				out[r] += sub * sub;
+			}
+		}
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline void l2_squared_x4_avx2(const double* q, const double* const* rows, size_t n, double* out)
+	{
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		__m256d acc2 = _mm256_setzero_pd();
+		__m256d acc3 = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			__m256d vq = _mm256_loadu_pd(q + i);
+			__m256d d0 = _mm256_sub_pd(vq, _mm256_loadu_pd(rows[0] + i));
+			__m256d d1 = _mm256_sub_pd(vq, _mm256_loadu_pd(rows[1] + i));
+			__m256d d2 = _mm256_sub_pd(vq, _mm256_loadu_pd(rows[2] + i));
+			__m256d d3 = _mm256_sub_pd(vq, _mm256_loadu_pd(rows[3] + i));
+			acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+			acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+			acc2 = _mm256_fmadd_pd(d2, d2, acc2);
+			acc3 = _mm256_fmadd_pd(d3, d3, acc3);
+		}
+		out[0] = hsum_avx(acc0); out[1] = hsum_avx(acc1); out[2] = hsum_avx(acc2); out[3] = hsum_avx(acc3);
+		for (; i < n; i++)
+		{
+			for (size_t r = 0; r < 4; r++)
+			{
+				double sub = q[i] - rows[r][i];
+				out[r] += sub * sub;
+			}
+		}
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline void dot_x4_avx2(const float* q, const float* const* rows, size_t n, float* out)
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		__m256 acc2 = _mm256_setzero_ps();
+		__m256 acc3 = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 vq = _mm256_loadu_ps(q + i);
+			acc0 = _mm256_fmadd_ps(vq, _mm256_loadu_ps(rows[0] + i), acc0);
+			acc1 = _mm256_fmadd_ps(vq, _mm256_loadu_ps(rows[1] + i), acc1);
+			acc2 = _mm256_fmadd_ps(vq, _mm256_loadu_ps(rows[2] + i), acc2);
+			acc3 = _mm256_fmadd_ps(vq, _mm256_loadu_ps(rows[3] + i), acc3);
+		}
+		out[0] = hsum_avx(acc0); out[1] = hsum_avx(acc1); out[2] = hsum_avx(acc2); out[3] = hsum_avx(acc3);
+		for (; i < n; i++)
+		{
+			for (size_t r = 0; r < 4; r++)
+				out[r] += q[i] * rows[r][i];
+		}
+	}
+
+	ANNY_TARGET("avx2,fma")
+	inline void dot_x4_avx2(const double* q, const double* const* rows, size_t n, double* out)
+	{
+		__m256d acc0 = _mm256_setzero_pd();
+		__m256d acc1 = _mm256_setzero_pd();
+		__m256d acc2 = _mm256_setzero_pd();
+		__m256d acc3 = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			__m256d vq = _mm256_loadu_pd(q + i);
+			acc0 = _mm256_fmadd_pd(vq, _mm256_loadu_pd(rows[0] + i), acc0);
+			acc1 = _mm256_fmadd_pd(vq, _mm256_loadu_pd(rows[1] + i), acc1);
+			acc2 = _mm256_fmadd_pd(vq, _mm256_loadu_pd(rows[2] + i), acc2);
+			acc3 = _mm256_fmadd_pd(vq, _mm256_loadu_pd(rows[3] + i), acc3);
+		}
+		out[0] = hsum_avx(acc0); out[1] = hsum_avx(acc1); out[2] = hsum_avx(acc2); out[3] = hsum_avx(acc3);
+		for (; i < n; i++)
+		{
+			for (size_t r = 0; r < 4; r++)
+				out[r] += q[i] * rows[r][i];
+		}
+	}
+
+	ANNY_TARGET("avx512f")
+	inline void l2_squared_x4_avx512(const float* q, const float* const* rows, size_t n, float* out)
+	{
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		__m512 acc2 = _mm512_setzero_ps();
+		__m512 acc3 = _mm512_setzero_ps();
+		for (size_t i = 0; i < n; i += 16)
+		{
+			__mmask16 mask = (n - i >= 16) ? __mmask16(0xFFFF) : __mmask16((1u << (n - i)) - 1);
+			__m512 vq = _mm512_maskz_loadu_ps(mask, q + i);
+			__m512 d0 = _mm512_sub_ps(vq, _mm512_maskz_loadu_ps(mask, rows[0] + i));
+			__m512 d1 = _mm512_sub_ps(vq, _mm512_maskz_loadu_ps(mask, rows[1] + i));
+			__m512 d2 = _mm512_sub_ps(vq, _mm512_maskz_loadu_ps(mask, rows[2] + i));
+			__m512 d3 = _mm512_sub_ps(vq, _mm512_maskz_loadu_ps(mask, rows[3] + i));
+			acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+			acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+			acc2 = _mm512_fmadd_ps(d2, d2, acc2);
+			acc3 = _mm512_fmadd_ps(d3, d3, acc3);
+		}
+		out[0] = _mm512_reduce_add_ps(acc0);
+		out[1] = _mm512_reduce_add_ps(acc1);
+		out[2] = _mm512_reduce_add_ps(acc2);
+		out[3] = _mm512_reduce_add_ps(acc3);
+	}
+
+	ANNY_TARGET("avx512f")
+	inline void l2_squared_x4_avx512(const double* q, const double* const* rows, size_t n, double* out)
+	{
+		__m512d acc0 = _mm512_setzero_pd();
+		__m512d acc1 = _mm512_setzero_pd();
+		__m512d acc2 = _mm512_setzero_pd();
+		__m512d acc3 = _mm512_setzero_pd();
+		for (size_t i = 0; i < n; i += 8)
+		{
+			__mmask8 mask = (n - i >= 8) ? __mmask8(0xFF) : __mmask8((1u << (n - i)) - 1);
+			__m512d vq = _mm512_maskz_loadu_pd(mask, q + i);
+			__m512d d0 = _mm512_sub_pd(vq, _mm512_maskz_loadu_pd(mask, rows[0] + i));
+			__m512d d1 = _mm512_sub_pd(vq, _mm512_maskz_loadu_pd(mask, rows[1] + i));
+			__m512d d2 = _mm512_sub_pd(vq, _mm512_maskz_loadu_pd(mask, rows[2] + i));
+			__m512d d3 = _mm512_sub_pd(vq, _mm512_maskz_loadu_pd(mask, rows[3] + i));
+			acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+			acc1 = _mm512_fmadd_pd(d1, d1, acc1);
+			acc2 = _mm512_fmadd_pd(d2, d2, acc2);
+			acc3 = _mm512_fmadd_pd(d3, d3, acc3);
+		}
+		out[0] = _mm512_reduce_add_pd(acc0);
+		out[1] = _mm512_reduce_add_pd(acc1);
+		out[2] = _mm512_reduce_add_pd(acc2);
+		out[3] = _mm512_reduce_add_pd(acc3);
+	}
+
+	ANNY_TARGET("avx512f")
+	inline void dot_x4_avx512(const float* q, const float* const* rows, size_t n, float* out)
+	{
+		__m512 acc0 = _mm512_setzero_ps();
+		__m512 acc1 = _mm512_setzero_ps();
+		__m512 acc2 = _mm512_setzero_ps();
+		__m512 acc3 = _mm512_setzero_ps();
+		for (size_t i = 0; i < n; i += 16)
+		{
+			__mmask16 mask = (n - i >= 16) ? __mmask16(0xFFFF) : __mmask16((1u << (n - i)) - 1);
+			__m512 vq = _mm512_maskz_loadu_ps(mask, q + i);
+			acc0 = _mm512_fmadd_ps(vq, _mm512_maskz_loadu_ps(mask, rows[0] + i), acc0);
+			acc1 = _mm512_fmadd_ps(vq, _mm512_maskz_loadu_ps(mask, rows[1] + i), acc1);
+			acc2 = _mm512_fmadd_ps(vq, _mm512_maskz_loadu_ps(mask, rows[2] + i), acc2);
+			acc3 = _mm512_fmadd_ps(vq, _mm512_maskz_loadu_ps(mask, rows[3] + i), acc3);
+		}
+		out[0] = _mm512_reduce_add_ps(acc0);
+		out[1] = _mm512_reduce_add_ps(acc1);
+		out[2] = _mm512_reduce_add_ps(acc2);
+		out[3] = _mm512_reduce_add_ps(acc3);
+	}
+
+	ANNY_TARGET("avx512f")
+	inline void dot_x4_avx512(const double* q, const double* const* rows, size_t n, double* out)
+	{
+		__m512d acc0 = _mm512_setzero_pd();
+		__m512d acc1 = _mm512_setzero_pd();
+		__m512d acc2 = _mm512_setzero_pd();
+		__m512d acc3 = _mm512_setzero_pd();
+		for (size_t i = 0; i < n; i += 8)
+		{
+			__mmask8 mask = (n - i >= 8) ? __mmask8(0xFF) : __mmask8((1u << (n - i)) - 1);
+			__m512d vq = _mm512_maskz_loadu_pd(mask, q + i);
+			acc0 = _mm512_fmadd_pd(vq, _mm512_maskz_loadu_pd(mask, rows[0] + i), acc0);
+			acc1 = _mm512_fmadd_pd(vq, _mm512_maskz_loadu_pd(mask, rows[1] + i), acc1);
+			acc2 = _mm512_fmadd_pd(vq, _mm512_maskz_loadu_pd(mask, rows[2] + i), acc2);
+			acc3 = _mm512_fmadd_pd(vq, _mm512_maskz_loadu_pd(mask, rows[3] + i), acc3);
+		}
+		out[0] = _mm512_reduce_add_pd(acc0);
+		out[1] = _mm512_reduce_add_pd(acc1);
+		out[2] = _mm512_reduce_add_pd(acc2);
+		out[3] = _mm512_reduce_add_pd(acc3);
+	}
+
+	// hardware popcount, 4 independent accumulators to hide its latency
+
+	ANNY_TARGET("popcnt")
+	inline uint64_t hamming_popcnt(const uint64_t* a, const uint64_t* b, size_t n)
+	{
+		uint64_t d0{ 0 }, d1{ 0 }, d2{ 0 }, d3{ 0 };
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			d0 += static_cast<uint64_t>(__builtin_popcountll(a[i] ^ b[i]));
+			d1 += static_cast<uint64_t>(__builtin_popcountll(a[i + 1] ^ b[i + 1]));
+			d2 += static_cast<uint64_t>(__builtin_popcountll(a[i + 2] ^ b[i + 2]));
+			d3 += static_cast<uint64_t>(__builtin_popcountll(a[i + 3] ^ b[i + 3]));
+		}
+		for (; i < n; i++)
+		{
+			d0 += static_cast<uint64_t>(__builtin_popcountll(a[i] ^ b[i]));
+		}
+		return d0 + d1 + d2 + d3;
+	}
+
+#endif  // ANNY_SIMD_X86
+}
+
+
+// best instruction set supported both by CPU and OS
+inline InstructionSet detect_instruction_set()
+{
+#ifdef ANNY_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return InstructionSet::AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return InstructionSet::AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return InstructionSet::SSE;
+#endif
+	return InstructionSet::SCALAR;
+}
+
+
+template <typename T>
+Kernels<T> make_kernels(InstructionSet isa)
+{
+	Kernels<T> k{ detail::l2_squared_scalar<T>, detail::dot_scalar<T>, detail::l1_scalar<T>, detail::linf_scalar<T>,
+		detail::l2_squared_x4_scalar<T>, detail::dot_x4_scalar<T> };
+#ifdef ANNY_SIMD_X86
+	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+	{
+		switch (isa)
+		{
+		case InstructionSet::AVX512:
+			k.l2_squared = detail::l2_squared_avx512;
+			k.dot = detail::dot_avx512;
+			k.l1 = detail::l1_avx512;
+			k.linf = detail::linf_avx512;
+			k.l2_squared_x4 = detail::l2_squared_x4_avx512;
+			k.dot_x4 = detail::dot_x4_avx512;
+			break;
+		case InstructionSet::AVX2:
+			k.l2_squared = detail::l2_squared_avx2;
+			k.dot = detail::dot_avx2;
+			k.l1 = detail::l1_avx2;
+			k.linf = detail::linf_avx2;
+			k.l2_squared_x4 = detail::l2_squared_x4_avx2;
+			k.dot_x4 = detail::dot_x4_avx2;
+			break;
+		case InstructionSet::SSE:
+			k.l2_squared = detail::l2_squared_sse;
+			k.dot = detail::dot_sse;
+			k.l1 = detail::l1_sse;
+			k.linf = detail::linf_sse;
+			k.l2_squared_x4 = detail::x4_by_rows<T, detail::l2_squared_sse>;
+			k.dot_x4 = detail::x4_by_rows<T, detail::dot_sse>;
+			break;
+		default: break;
+		}
+	}
+#endif
+	return k;
+}
+
+
+namespace detail
+{
+	inline InstructionSet& active_instruction_set()
+	{
+		static InstructionSet isa = detect_instruction_set();
+		return isa;
+	}
+
+	template <typename T>
+	Kernels<T>& active_kernels()
+	{
+		static Kernels<T> k = make_kernels<T>(active_instruction_set());
+		return k;
+	}
+
+	using hamming_func_t = uint64_t(*)(const uint64_t* a, const uint64_t* b, size_t n);
+
+	inline hamming_func_t make_hamming_kernel(InstructionSet isa)
+	{
+#ifdef ANNY_SIMD_X86
+		if (isa != InstructionSet::SCALAR && __builtin_cpu_supports("popcnt"))
+			return hamming_popcnt;
+#endif
+		return hamming_scalar;
+	}
+
+	inline hamming_func_t& active_hamming_kernel()
+	{
+		static hamming_func_t k = make_hamming_kernel(active_instruction_set());
+		return k;
+	}
+}
+
+
+inline InstructionSet get_instruction_set()
+{
+	return detail::active_instruction_set();
+}
+
+/*
+	Force kernels for a lower instruction set (for testing and benchmarking).
+	Requests above the detected one are clamped. Not thread-safe: call it before running any queries.
+*/
+inline InstructionSet set_instruction_set(InstructionSet isa)
+{
+	if (static_cast<int>(isa) > static_cast<int>(detect_instruction_set()))
+		isa = detect_instruction_set();
+	detail::active_instruction_set() = isa;
+	detail::active_kernels<float>() = make_kernels<float>(isa);
+	detail::active_kernels<double>() = make_kernels<double>(isa);
+	detail::active_hamming_kernel() = detail::make_hamming_kernel(isa);
+	return isa;
+}
+
+
+// vectors shorter than that are processed by inlineable scalar loops, avoiding an indirect call to the kernel
+inline constexpr size_t SHORT_VECTOR_SIZE = 8;
+
+
+template <typename T>
+T l2_distance_squared(const T* a, const T* b, size_t n)
+{
+	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+		return (n < SHORT_VECTOR_SIZE) ? detail::l2_squared_scalar(a, b, n) : detail::active_kernels<T>().l2_squared(a, b, n);
+	else
+		return detail::l2_squared_scalar(a, b, n);
+}
+
+template <typename T>
+T dot(const T* a, const T* b, size_t n)
+{
+	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+		return (n < SHORT_VECTOR_SIZE) ? detail::dot_scalar(a, b, n) : detail::active_kernels<T>().dot(a, b, n);
+	else
+		return detail::dot_scalar(a, b, n);
+}
+
+template <typename T>
+T l1_distance(const T* a, const T* b, size_t n)
+{
+	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+		return (n < SHORT_VECTOR_SIZE) ? detail::l1_scalar(a, b, n) : detail::active_kernels<T>().l1(a, b, n);
+	else
+		return detail::l1_scalar(a, b, n);
+}
+
+template <typename T>
+T linf_distance(const T* a, const T* b, size_t n)
+{
+	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+		return (n < SHORT_VECTOR_SIZE) ? detail::linf_scalar(a, b, n) : detail::active_kernels<T>().linf(a, b, n);
+	else
+		return detail::linf_scalar(a, b, n);
+}
+
+// distances from q to 4 rows at once: out[r] = |q - rows[r]|^2
+template <typename T>
+void l2_distance_squared_x4(const T* q, const T* const* rows, size_t n, T* out)
+{
+	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+		(n < SHORT_VECTOR_SIZE) ? detail::l2_squared_x4_scalar(q, rows, n, out) : detail::active_kernels<T>().l2_squared_x4(q, rows, n, out);
+	else
+		detail::l2_squared_x4_scalar(q, rows, n, out);
+}
+
+// dot products of q with 4 rows at once: out[r] = <q, rows[r]>
+template <typename T>
+void dot_x4(const T* q, const T* const* rows, size_t n, T* out)
+{
+	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+		(n < SHORT_VECTOR_SIZE) ? detail::dot_x4_scalar(q, rows, n, out) : detail::active_kernels<T>().dot_x4(q, rows, n, out);
+	else
+		detail::dot_x4_scalar(q, rows, n, out);
+}
+
+
+inline constexpr size_t CACHE_LINE_SIZE = 64;
+
+// hint to load the cache line with address p into all cache levels, it is a no-op where the builtin is unavailable
+inline void prefetch(const void* p)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(p, 0, 3);
+#endif
+}
+
+// prefetch the beginning of an array: hardware prefetcher takes over sequential reads after the first few lines
+template <typename T>
+void prefetch_array(const T* p, size_t n, size_t max_lines = 4)
+{
+	const char* first = reinterpret_cast<const char*>(p);
+	const char* last = reinterpret_cast<const char*>(p + n);
+	for (size_t line = 0; line < max_lines && first + line * CACHE_LINE_SIZE < last; line++)
+		prefetch(first + line * CACHE_LINE_SIZE);
+}
+
+
+// number of different bits in two bit strings packed into 64-bit words
+inline uint64_t hamming_distance(const uint64_t* a, const uint64_t* b, size_t n)
+{
+	return detail::active_hamming_kernel()(a, b, n);
+}
+
+}
+}
\ No newline at end of file
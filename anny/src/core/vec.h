@@ -1,11 +1,13 @@
 #pragma once
 
 #include <array>
+#include <cassert>
 #include <vector>
 #include <algorithm>
 #include <numeric>
 #include <utility>
 #include <type_traits>
+#include "simd.h"
 
 
 namespace anny
@@ -153,7 +155,7 @@ public:
     T dot(const Vec& other) const
     {
         assert(is_same_size(other));
-        return std::inner_product(m_data.begin(), m_data.end(), other.m_data.begin(), T{0});
+        return simd::dot(m_data.data(), other.m_data.data(), size());
     }
 
     template <typename DT>
@@ -207,7 +209,7 @@ template <typename T>
 T dot(const Vec<T>& left, const Vec<T>& right)
 {
     assert(left.is_same_size(right));
-    return std::inner_product(left.m_data.begin(), left.m_data.end(), right.m_data.begin(), T{0});
+    return simd::dot(left.m_data.data(), right.m_data.data(), left.size());
 }
 
 template <typename T>
@@ -111,7 +111,7 @@ public:
     T dot(VecView other) const
     {
         assert(is_same_size(other));
-        return std::inner_product(begin(), end(), other.begin(), T{ 0 });
+        return simd::dot<std::remove_cv_t<T>>(begin(), other.begin(), size());
     }
 
     template <typename DT>
@@ -168,7 +168,7 @@ template <typename T>
 T dot(VecView<T> left, VecView<T> right)
 {
     assert(left.is_same_size(right));
-    return std::inner_product(left.begin(), left.end(), right.begin(), T{ 0 });
+    return simd::dot<std::remove_cv_t<T>>(left.begin(), right.begin(), left.size());
 }
 
 template <typename T>
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace anny
+{
+namespace utils
+{
+	/*
+		Bitset - dense set of element indices, one bit per element (e.g. an allow-list of a filtered query).
+		Indices beyond size() are not in the set.
+	*/
+	class Bitset
+	{
+	public:
+		explicit Bitset(size_t size = 0)
+			: m_words((size + WORD_BITS - 1) / WORD_BITS, 0)
+			, m_size{ size }
+		{}
+
+		// set of the given indices, size is enough to hold the largest one
+		template <typename IndexContainer>
+		static Bitset from_indices(const IndexContainer& indices)
+		{
+			size_t size = 0;
+			for (const auto& i : indices)
+				size = std::max(size, static_cast<size_t>(i) + 1);
+			Bitset bitset(size);
+			for (const auto& i : indices)
+				bitset.set(static_cast<size_t>(i));
+			return bitset;
+		}
+
+		size_t size() const noexcept { return m_size; }
+
+		bool test(size_t index) const noexcept
+		{
+			return index < m_size && (m_words[index / WORD_BITS] >> (index % WORD_BITS)) & 1;
+		}
+
+		void set(size_t index, bool value = true) noexcept
+		{
+			const uint64_t mask = uint64_t{ 1 } << (index % WORD_BITS);
+			if (value)
+				m_words[index / WORD_BITS] |= mask;
+			else
+				m_words[index / WORD_BITS] &= ~mask;
+		}
+
+		// number of indices in the set
+		size_t count() const noexcept
+		{
+			size_t result = 0;
+			for (auto word : m_words)
+			{
+				for (; word; word &= word - 1)
+					result++;
+			}
+			return result;
+		}
+
+	private:
+		static constexpr size_t WORD_BITS = 64;
+
+		std::vector<uint64_t> m_words;
+		size_t m_size{ 0 };
+	};
+
+}
+}
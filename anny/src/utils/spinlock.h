@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+namespace anny
+{
+namespace utils
+{
+	/*
+		Spinlock - tiny lock for very short critical sections (copying or updating a few dozens of ints).
+		It is one byte and spins instead of sleeping, so millions of them (one per graph node) are cheap,
+		and uncontended lock/unlock is a single atomic exchange. Satisfies Lockable, usable with std::lock_guard.
+	*/
+	class Spinlock
+	{
+	public:
+		Spinlock() = default;
+		Spinlock(const Spinlock&) = delete;
+		Spinlock& operator=(const Spinlock&) = delete;
+
+		void lock() noexcept
+		{
+			while (m_flag.exchange(true, std::memory_order_acquire))
+			{
+				// wait reading only, so that waiting threads do not bounce the cache line between cores
+				size_t spins = 0;
+				while (m_flag.load(std::memory_order_relaxed))
+				{
+					if (++spins % 64 == 0)
+						std::this_thread::yield();
+				}
+			}
+		}
+
+		bool try_lock() noexcept
+		{
+			return !m_flag.load(std::memory_order_relaxed) && !m_flag.exchange(true, std::memory_order_acquire);
+		}
+
+		void unlock() noexcept
+		{
+			m_flag.store(false, std::memory_order_release);
+		}
+
+	private:
+		std::atomic<bool> m_flag{ false };
+	};
+
+}
+}
\ No newline at end of file
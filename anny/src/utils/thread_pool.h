@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace anny
+{
+namespace utils
+{
+	// number of threads to use when user passes 0 ("auto")
+	inline size_t default_num_threads()
+	{
+		size_t n = std::thread::hardware_concurrency();
+		return (n == 0) ? 1 : n;
+	}
+
+
+	/*
+		ThreadPool - fixed number of worker threads executing tasks from a shared FIFO queue.
+		Destructor finishes all queued tasks and joins the workers.
+	*/
+	class ThreadPool
+	{
+	public:
+		explicit ThreadPool(size_t num_threads = 0)
+		{
+			num_threads = (num_threads == 0) ? default_num_threads() : num_threads;
+			m_workers.reserve(num_threads);
+			for (size_t i = 0; i < num_threads; i++)
+				m_workers.emplace_back([this] { worker_loop(); });
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+			m_cv.notify_all();
+			for (auto& worker : m_workers)
+				worker.join();
+		}
+
+		size_t num_threads() const noexcept { return m_workers.size(); }
+
+		// schedules func() for execution, exception thrown by func is rethrown from future.get()
+		template <typename Func>
+		std::future<void> submit(Func&& func)
+		{
+			auto task = std::make_shared<std::packaged_task<void()>>(std::forward<Func>(func));
+			auto result = task->get_future();
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_tasks.push([task] { (*task)(); });
+			}
+			m_cv.notify_one();
+			return result;
+		}
+
+		/*
+			Splits [first, last) into contiguous chunks of at least min_chunk items, calls func(chunk_first, chunk_last)
+			for every chunk on the pool threads and waits for all of them. The first exception is rethrown.
+			Must not be called from a task running on the same pool.
+		*/
+		template <typename Func>
+		void parallel_for(size_t first, size_t last, Func&& func, size_t min_chunk = 1)
+		{
+			if (first >= last)
+				return;
+
+			const size_t n = last - first;
+			const size_t num_chunks = std::max<size_t>(1, std::min(num_threads(), n / std::max<size_t>(1, min_chunk)));
+			if (num_chunks == 1)
+			{
+				func(first, last);
+				return;
+			}
+
+			std::vector<std::future<void>> futures;
+			futures.reserve(num_chunks);
+			for (size_t c = 0; c < num_chunks; c++)
+			{
+				size_t chunk_first = first + n * c / num_chunks;
+				size_t chunk_last = first + n * (c + 1) / num_chunks;
+				futures.push_back(submit([&func, chunk_first, chunk_last] { func(chunk_first, chunk_last); }));
+			}
+			for (auto& f : futures)
+				f.wait();
+			for (auto& f : futures)
+				f.get();
+		}
+
+	private:
+		void worker_loop()
+		{
+			while (true)
+			{
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_cv.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+					if (m_stop && m_tasks.empty())
+						return;
+					task = std::move(m_tasks.front());
+					m_tasks.pop();
+				}
+				task();
+			}
+		}
+
+	private:
+		std::vector<std::thread> m_workers;
+		std::queue<std::function<void()>> m_tasks;
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		bool m_stop{ false };
+	};
+
+}
+}
\ No newline at end of file
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "../core/simd.h"
+
+namespace anny
+{
+namespace utils
+{
+	/*
+		VisitedList - dense "visited" marks of graph elements, cleared in O(1).
+		An element is visited if its mark equals the current epoch, so reset() only bumps the epoch.
+		The marks are really zeroed once per 65535 resets, when the epoch wraps around.
+	*/
+	class VisitedList
+	{
+	public:
+		using tag_t = uint16_t;
+
+		explicit VisitedList(size_t num_elements = 0)
+			: m_marks(num_elements, 0)
+		{}
+
+		size_t size() const noexcept { return m_marks.size(); }
+
+		// new elements are not visited
+		void resize(size_t num_elements) { m_marks.resize(num_elements, 0); }
+
+		// makes all elements not visited
+		void reset()
+		{
+			if (++m_epoch == 0)
+			{
+				std::fill(m_marks.begin(), m_marks.end(), tag_t{ 0 });
+				m_epoch = 1;
+			}
+		}
+
+		bool is_visited(size_t index) const noexcept { return m_marks[index] == m_epoch; }
+
+		// hint to load the mark of an element into cache before it is checked
+		void prefetch(size_t index) const noexcept { simd::prefetch(m_marks.data() + index); }
+
+		// marks element visited, returns false if it was already visited
+		bool visit(size_t index) noexcept
+		{
+			if (m_marks[index] == m_epoch)
+				return false;
+			m_marks[index] = m_epoch;
+			return true;
+		}
+
+	private:
+		std::vector<tag_t> m_marks;
+		tag_t m_epoch{ 1 };
+	};
+
+
+	/*
+		VisitedListPool - visited lists for concurrent searches over one graph.
+		A search checks out a list by get() and the returned handle gives it back to the pool on destruction,
+		so a list of num_elements marks is allocated once per concurrently running search, not per query.
+		Checked out lists are reset and grown to the current number of elements.
+	*/
+	class VisitedListPool
+	{
+	public:
+		class Handle
+		{
+		public:
+			Handle(const Handle&) = delete;
+			Handle& operator=(const Handle&) = delete;
+			Handle(Handle&&) = default;
+
+			~Handle()
+			{
+				if (m_list)
+					m_pool->release(std::move(m_list));
+			}
+
+			VisitedList& operator*() const noexcept { return *m_list; }
+			VisitedList* operator->() const noexcept { return m_list.get(); }
+
+		private:
+			friend class VisitedListPool;
+
+			Handle(VisitedListPool* pool, std::unique_ptr<VisitedList> list)
+				: m_pool(pool)
+				, m_list(std::move(list))
+			{}
+
+			VisitedListPool* m_pool;
+			std::unique_ptr<VisitedList> m_list;
+		};
+
+		explicit VisitedListPool(size_t num_elements = 0)
+			: m_numElements{ num_elements }
+		{}
+
+		VisitedListPool(const VisitedListPool&) = delete;
+		VisitedListPool& operator=(const VisitedListPool&) = delete;
+
+		// lists in the pool grow to the new size on their next checkout
+		void set_num_elements(size_t num_elements)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_numElements = num_elements;
+		}
+
+		size_t num_elements() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_numElements;
+		}
+
+		// number of lists waiting in the pool
+		size_t num_free() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_free.size();
+		}
+
+		Handle get()
+		{
+			std::unique_ptr<VisitedList> list;
+			size_t num_elements = 0;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				num_elements = m_numElements;
+				if (!m_free.empty())
+				{
+					list = std::move(m_free.back());
+					m_free.pop_back();
+				}
+			}
+
+			if (!list)
+				list = std::make_unique<VisitedList>(num_elements);
+			else if (list->size() < num_elements)
+				list->resize(num_elements);
+			list->reset();
+			return Handle(this, std::move(list));
+		}
+
+	private:
+		void release(std::unique_ptr<VisitedList> list)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_free.push_back(std::move(list));
+		}
+
+	private:
+		mutable std::mutex m_mutex;
+		std::vector<std::unique_ptr<VisitedList>> m_free;
+		size_t m_numElements{ 0 };
+	};
+
+}
+}
\ No newline at end of file
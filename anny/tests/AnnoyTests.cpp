@@ -1,8 +1,11 @@
 #include <iostream>
+#include <filesystem>
 #include <gtest/gtest.h>
 #include "algs/annoy.h"
+#include "algs/vanilla_knn.h"
 #include "utils/csv_loader.h"
 #include "core/distance.h"
+#include "core/matrix_mmap.h"
 #include "utils/dataset_creator.h"
 #include <string>
 
@@ -17,7 +20,7 @@ TEST(AnnoyTests, AnnoyBuildTreeTest)
 		{0.0, -1.0}
 	};
 
-	Annoy<double, L2Distance> alg1(1, 1);
+	Annoy<double, L2Distance> alg1(1, 1, /*seed*/ 0);  // single tree gives approximate results, so pin the seed
 	alg1.fit(data);
 
 	{
@@ -40,7 +43,7 @@ TEST(AnnoyTests, AnnoyBuildTreeTest)
 	}
 
 	
-	Annoy<double, L2Distance> alg3(1, 3);
+	Annoy<double, L2Distance> alg3(1, 3, /*seed*/ 0);
 	alg3.fit(data);
 
 	{
@@ -285,3 +288,62 @@ TEST(AnnoyTests, AnnoyTestRandomDatasetUniform)
 {
 	auto data = anny::utils::make_uniform(1000, 2, -100.0, 100.0);
 }
+
+TEST(AnnoyTests, AnnoyTestInnerProduct)
+{
+	auto data = anny::utils::make_uniform<double>(500, 4, -10.0, 10.0);
+
+	Annoy<double, InnerProductDistance> alg(50, 10, /*seed*/ 777);
+	alg.fit(data);
+	VanillaKnn<double, InnerProductDistance> exact;
+	exact.fit(data);
+
+	auto queries = anny::utils::make_uniform<double>(20, 4, -1.0, 1.0);
+	size_t num_found = 0;
+	for (const auto& query : queries)
+	{
+		auto result = alg.knn_query(query, 1);
+		auto expected = exact.knn_query(query, 1);
+		ASSERT_EQ(result.size(), 1);
+		num_found += (result == expected);
+	}
+	EXPECT_GE(num_found, 18);
+
+	Annoy<double, InnerProductDistance> empty(10, 1);
+	EXPECT_NO_THROW(empty.fit(std::vector<std::vector<double>>{}));
+}
+
+TEST(AnnoyTests, AnnoyTestBorrowedDataCosine)
+{
+	// cosine index normalizes its data, borrowed caller memory must stay untouched
+	std::vector<double> flat = { 3.0, 4.0, 0.0, 2.0, -6.0, 8.0, 1.0, 1.0 };
+	const std::vector<double> original = flat;
+
+	Annoy<double, CosineDistance> alg(10, 1);
+	alg.fit(flat.data(), 4, 2);
+	EXPECT_EQ(flat, original);
+
+	auto result = alg.knn_query({ 0.6, 0.8 }, 1);
+	EXPECT_EQ(result, IndexVector{ 0 });
+}
+
+TEST(AnnoyTests, AnnoyTestSharedAndMappedDataCosine)
+{
+	// adopted memory seen by someone else (a copy of the view, a mapped file) is not normalized in place
+	MatrixStorageView<double> shared(MatrixStorageAligned<double>({ { 3.0, 4.0 }, { 0.0, 2.0 }, { -6.0, 8.0 }, { 1.0, 1.0 } }));
+	const MatrixStorageView<double> original = shared.clone();
+	Annoy<double, CosineDistance> alg(10, 1);
+	alg.fit(Matrix<double, MatrixStorageView<double>>(MatrixStorageView<double>(shared)));  // the copy shares memory
+	EXPECT_EQ(shared, original);
+	EXPECT_EQ(alg.knn_query({ 0.6, 0.8 }, 1), IndexVector{ 0 });
+
+	const std::string path = (std::filesystem::temp_directory_path() / "anny_annoy_mapped_test.bin").string();
+	MatrixStorageMmap<double>::write(path, Matrix<double, MatrixStorageView<double>>(original));
+	Annoy<double, CosineDistance> mapped_alg(10, 1);
+	mapped_alg.fit(Matrix<double, MatrixStorageMmap<double>>(MatrixStorageMmap<double>(path)));
+	EXPECT_EQ(mapped_alg.knn_query({ 0.6, 0.8 }, 1), IndexVector{ 0 });
+	const MatrixStorageMmap<double> file(path);
+	for (size_t i = 0; i < original.num_rows(); i++)
+		EXPECT_EQ(file[i], original[i]);
+	std::filesystem::remove(path);
+}
@@ -0,0 +1,34 @@
+#include <vector>
+#include <gtest/gtest.h>
+#include "utils/bitset.h"
+
+using namespace anny::utils;
+
+
+TEST(BitsetTests, BitsetTest)
+{
+    Bitset bitset(130);
+    EXPECT_EQ(bitset.size(), 130);
+    EXPECT_EQ(bitset.count(), 0);
+    bitset.set(0);
+    bitset.set(64);
+    bitset.set(129);
+    EXPECT_TRUE(bitset.test(0));
+    EXPECT_TRUE(bitset.test(64));
+    EXPECT_TRUE(bitset.test(129));
+    EXPECT_FALSE(bitset.test(1));
+    EXPECT_FALSE(bitset.test(130));  // beyond the size
+    EXPECT_EQ(bitset.count(), 3);
+
+    bitset.set(64, false);
+    EXPECT_FALSE(bitset.test(64));
+    EXPECT_EQ(bitset.count(), 2);
+
+    auto from_indices = Bitset::from_indices(std::vector<size_t>{ 5, 70, 3 });
+    EXPECT_EQ(from_indices.size(), 71);
+    EXPECT_EQ(from_indices.count(), 3);
+    EXPECT_TRUE(from_indices.test(3));
+    EXPECT_TRUE(from_indices.test(70));
+    EXPECT_FALSE(from_indices.test(4));
+    EXPECT_EQ(Bitset::from_indices(std::vector<size_t>{}).size(), 0);
+}
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include "algs/vanilla_knn.h"
+#include "algs/kdtree.h"
+#include "algs/annoy.h"
+#include "algs/hnsw.h"
+#include "core/distance.h"
+#include "utils/dataset_creator.h"
+
+using namespace anny;
+
+namespace
+{
+	// many threads query one shared const index at the same time, every result must be the same as in serial execution
+	void stress_concurrent_queries(const IKnnAlgorithm<double>& alg, const std::vector<std::vector<double>>& queries,
+		size_t k, double radius, bool with_radius, size_t num_threads = 4, size_t num_rounds = 3)
+	{
+		std::vector<IndexVector> expected_knn;
+		std::vector<IndexVector> expected_radius;
+		for (const auto& q : queries)
+		{
+			expected_knn.push_back(alg.knn_query(q, k));
+			if (with_radius)
+				expected_radius.push_back(alg.radius_query(q, radius));
+		}
+
+		std::atomic<size_t> num_mismatches{ 0 };
+		std::atomic<bool> start{ false };
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < num_threads; t++)
+		{
+			threads.emplace_back([&, t] {
+				while (!start.load())
+					std::this_thread::yield();
+				for (size_t round = 0; round < num_rounds; round++)
+				{
+					// every thread walks queries in its own order
+					for (size_t i = 0; i < queries.size(); i++)
+					{
+						size_t qi = (i * (2 * t + 1) + round) % queries.size();
+						if (alg.knn_query(queries[qi], k) != expected_knn[qi])
+							num_mismatches++;
+						if (with_radius && alg.radius_query(queries[qi], radius) != expected_radius[qi])
+							num_mismatches++;
+					}
+				}
+				});
+		}
+		start = true;
+		for (auto& thread : threads)
+			thread.join();
+
+		EXPECT_EQ(num_mismatches.load(), 0);
+	}
+}
+
+TEST(ConcurrentQueryTests, ConcurrentQueriesMatchSerial)
+{
+	std::vector<anny::utils::GaussianCluster<double>> clusters = {
+		{{-5, -5, 0, 1}, 1.0, 150},
+		{{5, 5, 1, 0}, 2.0, 150}
+	};
+	auto data = anny::utils::make_clusters<double>(clusters, -100.0, 100.0);
+	std::vector<std::vector<double>> queries(data.begin(), data.begin() + 40);
+	queries.insert(queries.end(), data.end() - 40, data.end());
+
+	{
+		VanillaKnn<double, L2Distance> alg;
+		alg.fit(data);
+		stress_concurrent_queries(alg, queries, 10, 1.5, true);
+	}
+	{
+		KDTree<double, L2Distance> alg(10);
+		alg.fit(data);
+		stress_concurrent_queries(alg, queries, 10, 1.5, true);
+	}
+	{
+		Annoy<double, CosineDistance> alg(10, 5);
+		alg.fit(data);
+		stress_concurrent_queries(alg, queries, 10, 0.01, true);
+	}
+	{
+		HNSW<double, L2Distance> alg(8, 50, 50);
+		alg.fit(data);
+		stress_concurrent_queries(alg, queries, 10, 1.5, true);
+	}
+}
@@ -1,9 +1,12 @@
 #include <iostream>
+#include <random>
 #include <gtest/gtest.h>
 #include "core/vec.h"
 #include "core/vec_view.h"
 #include "core/matrix.h"
 #include "core/distance.h"
+#include "core/simd.h"
+#include "core/mips_transform.h"
 
 using namespace anny;
 
@@ -53,7 +56,329 @@ TEST(DistanceTests, DistanceFactoryTest)
         auto distance_func = distance_func_factory<float>(anny::DistanceId::L2);
         EXPECT_TRUE(are_floats_equal((float)sqrt(27.0f), distance_func(v1.view(), v2.view())));
 
+        auto distance_squared_func = distance_func_factory<float>(anny::DistanceId::L2_SQUARED);
+        EXPECT_TRUE(are_floats_equal(27.0f, distance_squared_func(v1.view(), v2.view())));
     }
 }
 
+TEST(DistanceTests, SearchDistanceTest)
+{
+    Vec<double> v1 = { 1.0, 2.0, 3.0 };
+    Vec<double> v2 = { 4.0, 5.0, 6.0 };
+
+    using L2Search = SearchDistance<L2Distance>;
+    static_assert(std::is_same_v<L2Search::type, L2SquaredDistance>);
+    L2Search::type l2_search;
+    EXPECT_EQ(l2_search(v1.view(), v2.view()), 27.0);
+    EXPECT_EQ(L2Search::to_distance(l2_search(v1.view(), v2.view())), L2Distance()(v1.view(), v2.view()));
+    EXPECT_EQ(L2Search::from_distance(3.0), 9.0);
+    EXPECT_EQ(L2Search::from_distance(-3.0), -9.0);
+
+    using CosineSearch = SearchDistance<CosineDistance>;
+    static_assert(std::is_same_v<CosineSearch::type, CosineDistance>);
+    EXPECT_EQ(CosineSearch::from_distance(0.5), 0.5);
+    EXPECT_EQ(CosineSearch::to_distance(0.5), 0.5);
+}
+
+
+
+template <typename T>
+void check_simd_kernels(simd::InstructionSet isa)
+{
+    std::default_random_engine gen;
+    std::uniform_real_distribution<T> dis{ T{ -10 }, T{ 10 } };
+
+    // cover all combinations of full registers and tails for every instruction set
+    for (size_t n = 0; n <= 67; n++)
+    {
+        std::vector<T> a(n), b(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            a[i] = dis(gen);
+            b[i] = dis(gen);
+        }
+        const auto kernels = simd::make_kernels<T>(isa);
+        const T l2_expected = simd::detail::l2_squared_scalar(a.data(), b.data(), n);
+        const T dot_expected = simd::detail::dot_scalar(a.data(), b.data(), n);
+        EXPECT_NEAR(kernels.l2_squared(a.data(), b.data(), n), l2_expected, T{ 1e-3 } * (1 + std::fabs(l2_expected)));
+        EXPECT_NEAR(kernels.dot(a.data(), b.data(), n), dot_expected, T{ 1e-3 } * (1 + std::fabs(dot_expected)));
+        const T l1_expected = simd::detail::l1_scalar(a.data(), b.data(), n);
+        EXPECT_NEAR(kernels.l1(a.data(), b.data(), n), l1_expected, T{ 1e-3 } * (1 + l1_expected));
+        EXPECT_EQ(kernels.linf(a.data(), b.data(), n), simd::detail::linf_scalar(a.data(), b.data(), n));  // max is exact
+
+        // register-blocked kernels: query a against 4 rows
+        std::vector<T> c(n), d(n), e(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            c[i] = dis(gen);
+            d[i] = dis(gen);
+            e[i] = dis(gen);
+        }
+        const T* rows[4] = { b.data(), c.data(), d.data(), e.data() };
+        T l2_x4[4], dot_x4[4];
+        kernels.l2_squared_x4(a.data(), rows, n, l2_x4);
+        kernels.dot_x4(a.data(), rows, n, dot_x4);
+        for (size_t r = 0; r < 4; r++)
+        {
+            const T l2_row = simd::detail::l2_squared_scalar(a.data(), rows[r], n);
+            const T dot_row = simd::detail::dot_scalar(a.data(), rows[r], n);
+            EXPECT_NEAR(l2_x4[r], l2_row, T{ 1e-3 } * (1 + std::fabs(l2_row)));
+            EXPECT_NEAR(dot_x4[r], dot_row, T{ 1e-3 } * (1 + std::fabs(dot_row)));
+        }
+    }
+}
+
+TEST(DistanceTests, SimdKernelsTest)
+{
+    const auto best = simd::detect_instruction_set();
+    for (int i = 0; i <= static_cast<int>(best); i++)
+    {
+        auto isa = static_cast<simd::InstructionSet>(i);
+        check_simd_kernels<float>(isa);
+        check_simd_kernels<double>(isa);
+    }
 
+    // distance functions dispatch to the active kernels transparently
+    Vec<float> v1 = { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f };
+    Vec<float> v2 = { 9.0f, 8.0f, 7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f };
+    for (int i = 0; i <= static_cast<int>(best); i++)
+    {
+        simd::set_instruction_set(static_cast<simd::InstructionSet>(i));
+        EXPECT_FLOAT_EQ(l2_distance_squared(v1.view(), v2.view()), 240.0f);
+        EXPECT_FLOAT_EQ(dot(v1.view(), v2.view()), 165.0f);
+    }
+    EXPECT_EQ(simd::set_instruction_set(best), best);
+    EXPECT_EQ(simd::get_instruction_set(), best);
+}
+
+TEST(DistanceTests, InnerProductDistanceTest)
+{
+    Vec<double> v1 = { 1.0, 2.0, 3.0 };
+    Vec<double> v2 = { 4.0, 5.0, 6.0 };
+
+    EXPECT_EQ(InnerProductDistance()(v1.view(), v2.view()), 1.0 - 32.0);
+    auto distance_func = distance_func_factory<double>(anny::DistanceId::INNER_PRODUCT);
+    EXPECT_EQ(distance_func(v1.view(), v2.view()), 1.0 - 32.0);
+}
+
+TEST(DistanceTests, MipsTransformTest)
+{
+    Matrix<double> data = {
+        {1.0, 0.0},
+        {0.0, 2.0},
+        {-3.0, 4.0}
+    };
+    MipsTransform<double> mips;
+    auto augmented = mips.fit_transform(data);
+    EXPECT_EQ(mips.max_norm_squared(), 25.0);
+    EXPECT_EQ(augmented.shape(), Shape(3, 3));
+    for (size_t i = 0; i < augmented.num_rows(); i++)
+    {
+        EXPECT_DOUBLE_EQ(l2_norm_squared(augmented[i]), 25.0);  // all augmented points lie on a sphere
+    }
+
+    std::vector<double> q = { 2.0, 1.0 };
+    auto q_aug = mips.transform_query(q);
+    const double q_norm_squared = l2_norm_squared(q_aug.view());
+    for (size_t i = 0; i < augmented.num_rows(); i++)
+    {
+        double ip_dist = InnerProductDistance()(q_aug.view(), augmented[i]);
+        double l2_squared = L2SquaredDistance()(q_aug.view(), augmented[i]);
+        EXPECT_DOUBLE_EQ(ip_dist, inner_product_distance(Vec<double>(q).view(), data[i]));
+        EXPECT_NEAR(mips.to_l2_squared(ip_dist, q_norm_squared), l2_squared, 1e-9);
+        EXPECT_NEAR(mips.from_l2_squared(l2_squared, q_norm_squared), ip_dist, 1e-9);
+    }
+
+    // empty data gets an empty augmented matrix
+    auto empty = mips.fit_transform(Matrix<double>(0, 2));
+    EXPECT_EQ(mips.max_norm_squared(), 0.0);
+    EXPECT_EQ(empty.shape(), Shape(0, 3));
+}
+
+TEST(DistanceTests, ManhattanChebyshevDistanceTest)
+{
+    Vec<double> v1 = { 1.0, -2.0, 3.0 };
+    Vec<double> v2 = { 4.0, 5.0, 2.0 };
+
+    EXPECT_EQ(ManhattanDistance()(v1.view(), v2.view()), 3.0 + 7.0 + 1.0);
+    EXPECT_EQ(ChebyshevDistance()(v1.view(), v2.view()), 7.0);
+    EXPECT_EQ(distance_func_factory<double>(anny::DistanceId::MANHATTAN)(v1.view(), v2.view()), 11.0);
+    EXPECT_EQ(distance_func_factory<double>(anny::DistanceId::CHEBYSHEV)(v1.view(), v2.view()), 7.0);
+
+    Vec<int> vi1 = { 1, 2 };
+    Vec<int> vi2 = { 4, -2 };
+    EXPECT_EQ(manhattan_distance(vi1.view(), vi2.view()), 7);
+    EXPECT_EQ(chebyshev_distance(vi1.view(), vi2.view()), 4);
+}
+
+TEST(DistanceTests, HammingDistanceTest)
+{
+    Vec<uint64_t> v1 = { 0b1011, 0xFFFFFFFFFFFFFFFFULL, 0 };
+    Vec<uint64_t> v2 = { 0b0110, 0, 0 };
+    EXPECT_EQ(HammingDistance()(v1.view(), v2.view()), 3u + 64u);
+    EXPECT_EQ(distance_func_factory<uint64_t>(anny::DistanceId::HAMMING)(v1.view(), v2.view()), 67u);
+    EXPECT_THROW(distance_func_factory<float>(anny::DistanceId::HAMMING), std::runtime_error);
+
+    Vec<uint8_t> b1 = { 0b1111, 0b1 };
+    Vec<uint8_t> b2 = { 0b0000, 0b1 };
+    EXPECT_EQ(hamming_distance(b1.view(), b2.view()), 4);
+
+    // all instruction sets give the same result
+    std::default_random_engine gen;
+    std::uniform_int_distribution<uint64_t> dis;
+    std::vector<uint64_t> a(37), b(37);
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        a[i] = dis(gen);
+        b[i] = dis(gen);
+    }
+    const auto expected = simd::detail::hamming_scalar(a.data(), b.data(), a.size());
+    const auto best = simd::detect_instruction_set();
+    for (int i = 0; i <= static_cast<int>(best); i++)
+    {
+        simd::set_instruction_set(static_cast<simd::InstructionSet>(i));
+        EXPECT_EQ(simd::hamming_distance(a.data(), b.data(), a.size()), expected);
+    }
+    simd::set_instruction_set(best);
+}
+
+TEST(DistanceTests, StaticDispatchTest)
+{
+    static_assert(std::is_same_v<distance_by_id_t<DistanceId::L2>, L2Distance>);
+    static_assert(std::is_same_v<distance_by_id_t<DistanceId::HAMMING>, HammingDistance>);
+    static_assert(distance_by_id_t<DistanceId::COSINE>::id == DistanceId::COSINE);
+
+    Vec<float> v1 = { 1.0f, 2.0f, 3.0f };
+    Vec<float> v2 = { 4.0f, 5.0f, 7.0f };
+
+    for (auto id : { DistanceId::L2, DistanceId::L2_SQUARED, DistanceId::COSINE, DistanceId::INNER_PRODUCT, DistanceId::MANHATTAN, DistanceId::CHEBYSHEV })
+    {
+        float result = visit_distance<float>(id, [&](auto dist) {
+            EXPECT_EQ(decltype(dist)::id, id);
+            return dist(v1.view(), v2.view());
+        });
+        EXPECT_EQ(result, distance_func_factory<float>(id)(v1.view(), v2.view()));
+    }
+    auto visitor = [](auto) { return 0; };
+    EXPECT_THROW(visit_distance<float>(DistanceId::HAMMING, visitor), std::runtime_error);
+    EXPECT_THROW(visit_distance<float>(DistanceId::UNKNOWN, visitor), std::runtime_error);
+    EXPECT_EQ(visit_distance<uint64_t>(DistanceId::HAMMING, visitor), 0);
+}
+
+
+template <typename Dist>
+void check_distance_batch(const Matrix<float>& m, const Vec<float>& q)
+{
+    Dist dist;
+    std::vector<float> out;
+
+    // row range
+    distance_batch<Dist>(q.view(), m, 0, m.num_rows(), out);
+    ASSERT_EQ(out.size(), m.num_rows());
+    for (size_t i = 0; i < m.num_rows(); i++)
+        EXPECT_NEAR(out[i], dist(m[i], q.view()), 1e-4f * (1 + std::fabs(out[i])));
+    auto all_rows = out;
+
+    // list of indices: any order, repeats, every tail length; a row gets the same distance in any position
+    for (size_t count = 0; count <= 9; count++)
+    {
+        std::vector<size_t> indices;
+        for (size_t i = 0; i < count; i++)
+            indices.push_back((i * 7 + 3) % m.num_rows());
+        distance_batch<Dist>(q.view(), m, indices, out);
+        ASSERT_EQ(out.size(), count);
+        for (size_t i = 0; i < count; i++)
+            EXPECT_EQ(out[i], all_rows[indices[i]]);
+    }
+
+    distance_batch<Dist>(q.view(), m, 2, 2, out);
+    EXPECT_TRUE(out.empty());
+
+    // padded rows of aligned storage are processed up to the whole stride, the result is the same
+    MatrixStorageAligned<float> aligned_storage(m.num_rows(), m.num_cols());
+    for (size_t i = 0; i < m.num_rows(); i++)
+        std::copy(m[i].begin(), m[i].end(), aligned_storage[i].begin());
+    Matrix<float, MatrixStorageAligned<float>> aligned(std::move(aligned_storage));
+    distance_batch<Dist>(q.view(), aligned, 0, aligned.num_rows(), out);
+    for (size_t i = 0; i < m.num_rows(); i++)
+    {
+        EXPECT_NEAR(out[i], all_rows[i], 1e-4f * (1 + std::fabs(out[i])));
+        EXPECT_EQ(distance_to_row<Dist>(q.view(), aligned, i), out[i]);
+    }
+
+    // query padded once by the caller and aligned rows with their padding give the same distances
+    std::vector<float> buffer;
+    auto padded = pad_query<Dist>(VecView<const float>(q.view()), aligned, buffer);
+    EXPECT_EQ(pad_query<Dist>(VecView<const float>(q.view()), m, buffer).cbegin(), q.view().cbegin());
+    auto aligned_rows = out;
+    distance_batch<Dist>(padded, aligned, 0, aligned.num_rows(), out);
+    for (size_t i = 0; i < m.num_rows(); i++)
+    {
+        EXPECT_EQ(out[i], aligned_rows[i]);
+        EXPECT_EQ(distance_to_row<Dist>(padded, aligned, i), out[i]);
+        EXPECT_EQ(distance_to_row<Dist>(padded_row<Dist>(aligned, 0), aligned, i), distance_to_row<Dist>(aligned[0], aligned, i));
+    }
+}
+
+TEST(DistanceTests, DistanceBatchTest)
+{
+    std::default_random_engine gen;
+    std::uniform_real_distribution<float> dis{ -1.0f, 1.0f };
+
+    for (size_t cols : { 3, 19, 64 })
+    {
+        Matrix<float> m(11, cols);
+        Vec<float> q(cols);
+        for (size_t i = 0; i < m.num_rows(); i++)
+            for (size_t j = 0; j < cols; j++)
+                m(i, j) = dis(gen);
+        for (size_t j = 0; j < cols; j++)
+            q[j] = dis(gen);
+
+        check_distance_batch<L2Distance>(m, q);
+        check_distance_batch<L2SquaredDistance>(m, q);
+        check_distance_batch<CosineDistance>(m, q);
+        check_distance_batch<InnerProductDistance>(m, q);
+        check_distance_batch<ManhattanDistance>(m, q);
+        check_distance_batch<ChebyshevDistance>(m, q);
+    }
+}
+template <typename Dist>
+void check_borrowed_columns(const std::vector<float>& wide, size_t rows, size_t cols, size_t stride, const Vec<float>& q)
+{
+    Dist dist;
+    std::vector<float> out;
+    std::vector<float> buffer;
+    const Matrix<float, MatrixStorageView<float>> m{ MatrixStorageView<float>(wide.data(), rows, cols, stride) };
+    EXPECT_EQ(m.storage().padded_stride(), cols);
+
+    auto padded = pad_query<Dist>(VecView<const float>(q.view()), m, buffer);
+    EXPECT_EQ(padded.size(), cols);
+    distance_batch<Dist>(padded, m, 0, rows, out);
+    for (size_t i = 0; i < rows; i++)
+    {
+        EXPECT_NEAR(out[i], dist(m[i], q.view()), 1e-4f * (1 + std::fabs(out[i])));
+        EXPECT_EQ(distance_to_row<Dist>(q.view(), m, i), out[i]);
+        EXPECT_EQ(padded_row<Dist>(m, i).size(), cols);
+    }
+}
+
+TEST(DistanceTests, DistanceBatchBorrowedColumnsTest)
+{
+    // borrowed rows are columns [0, 3) of a wider array, the other columns don't take part in distances
+    const size_t rows = 9, cols = 3, stride = 8;
+    std::vector<float> wide(rows * stride);
+    for (size_t i = 0; i < wide.size(); i++)
+        wide[i] = (i % stride < cols) ? 0.25f * (i % 7) - 0.5f : 100.0f + i;
+    Vec<float> q(cols);
+    q[0] = 0.5f;
+    q[1] = -0.25f;
+    q[2] = 1.0f;
+
+    check_borrowed_columns<L2Distance>(wide, rows, cols, stride, q);
+    check_borrowed_columns<L2SquaredDistance>(wide, rows, cols, stride, q);
+    check_borrowed_columns<CosineDistance>(wide, rows, cols, stride, q);
+    check_borrowed_columns<InnerProductDistance>(wide, rows, cols, stride, q);
+    check_borrowed_columns<ManhattanDistance>(wide, rows, cols, stride, q);
+    check_borrowed_columns<ChebyshevDistance>(wide, rows, cols, stride, q);
+}
@@ -95,4 +95,66 @@ TEST(GraphTests, GraphTestCustomVertexType)
     g.insert_vertex(1);
     EXPECT_FALSE(g.insert_vertex(257));  // overflow, unsigned char(257) = 1
 
-}
\ No newline at end of file
+}
+
+TEST(GraphTests, GraphTestBfsOrderRelabel)
+{
+    std::unordered_map<size_t, std::vector<size_t>> adj = {
+        {0, {2, 1}},
+        {1, {0}},
+        {2, {0, 3, 4}},
+        {3, {2}},
+        {4, {2}},
+        {5, {}}
+    };
+
+    Graph g(adj);
+
+    // neighbors of a vertex by increasing degree, not reachable vertex last
+    const std::vector<size_t> expected_order = { 2, 3, 4, 0, 1, 5 };
+    const auto order = g.bfs_order(2);
+    EXPECT_EQ(order, expected_order);
+    EXPECT_THROW(g.bfs_order(10), std::out_of_range);
+
+    g.relabel(order);
+    EXPECT_EQ(g.num_vertices(), 6);
+    EXPECT_EQ(g.num_edges(), 4);
+    EXPECT_TRUE(g.has_edge(0, 1));
+    EXPECT_TRUE(g.has_edge(0, 2));
+    EXPECT_TRUE(g.has_edge(0, 3));
+    EXPECT_TRUE(g.has_edge(3, 4));
+    EXPECT_FALSE(g.has_edge(1, 2));
+    EXPECT_TRUE(g.get_adj_vertices(5).empty());
+
+    EXPECT_THROW(g.relabel({ 0, 1, 2 }), std::invalid_argument);
+    EXPECT_THROW(g.relabel({ 0, 0, 1, 2, 3, 4 }), std::invalid_argument);
+}
+
+TEST(GraphTests, GraphTestBfsOrderNonContiguousIds)
+{
+    std::unordered_map<size_t, std::vector<size_t>> adj = {
+        {0, {5}},
+        {5, {0, 9}},
+        {9, {5}},
+        {12, {}}
+    };
+
+    Graph g(adj);
+    EXPECT_EQ(g.num_edges(), 2);
+
+    // ids are not 0..n-1: every vertex is ordered once, not reachable vertex last
+    const std::vector<size_t> expected_order = { 9, 5, 0, 12 };
+    const auto order = g.bfs_order(9);
+    EXPECT_EQ(order, expected_order);
+    EXPECT_EQ(g.bfs_order(12), (std::vector<size_t>{ 12, 0, 5, 9 }));
+    EXPECT_THROW(g.bfs_order(1), std::out_of_range);
+
+    g.relabel(order);
+    EXPECT_EQ(g.num_vertices(), 4);
+    EXPECT_EQ(g.num_edges(), 2);
+    EXPECT_TRUE(g.has_edge(0, 1));
+    EXPECT_TRUE(g.has_edge(1, 2));
+    EXPECT_FALSE(g.has_edge(0, 2));
+    EXPECT_TRUE(g.get_adj_vertices(3).empty());
+    EXPECT_TRUE(Graph<size_t>().bfs_order(0).empty());
+}
@@ -1,6 +1,9 @@
 #include <iostream>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
 #include "algs/hnsw.h"
+#include "algs/vanilla_knn.h"
 #include "core/distance.h"
 #include "utils/dataset_creator.h"
 #include <string>
@@ -68,3 +71,611 @@ TEST(HNSWTests, HNSWTestRandomDatasetClusters)
 		EXPECT_EQ(result.size(), top_n);  // make sure we always take enough neighbors
 	}
 }
+
+TEST(HNSWTests, HNSWTestInnerProduct)
+{
+	auto data = anny::utils::make_uniform<double>(1000, 8, -10.0, 10.0);
+
+	HNSW<double, InnerProductDistance> alg(/*M*/ 16, /*efConstruction*/ 100, /*efSearch*/ 100);
+	alg.fit(data);
+	VanillaKnn<double, InnerProductDistance> exact;
+	exact.fit(data);
+
+	auto queries = anny::utils::make_uniform<double>(50, 8, -1.0, 1.0);
+	const size_t top_n = 10;
+	size_t num_found = 0;
+	for (const auto& query : queries)
+	{
+		auto result = alg.knn_query(query, top_n);
+		auto expected = exact.knn_query(query, top_n);
+		for (const auto& i : result)
+			num_found += std::count(expected.begin(), expected.end(), i);
+	}
+	EXPECT_GE(num_found, 0.9 * top_n * queries.size());  // recall@10
+}
+
+TEST(HNSWTests, HNSWTestQueryContext)
+{
+	auto data = anny::utils::make_uniform<double>(2000, 8, -10.0, 10.0);
+
+	HNSW<double, L2Distance> alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 20);
+	alg.fit(data);
+
+	// one context reused by all queries, results are written into caller buffers
+	HNSW<double, L2Distance>::QueryContext context;
+	auto queries = anny::utils::make_uniform<double>(100, 8, -10.0, 10.0);
+	for (size_t top_n : { 1, 10, 50 })
+	{
+		std::vector<index_t> indices(top_n);
+		std::vector<double> distances(top_n);
+		for (const auto& query : queries)
+		{
+			auto expected = alg.knn_query_with_distances(query, top_n);
+			size_t count = alg.knn_query_into(query.data(), top_n, indices.data(), distances.data(), context);
+			ASSERT_EQ(count, expected.size());
+			for (size_t i = 0; i < count; i++)
+			{
+				EXPECT_EQ(indices[i], expected[i].first);
+				EXPECT_EQ(distances[i], expected[i].second);
+			}
+
+			count = alg.knn_query_into(query.data(), top_n, indices.data(), nullptr, context);
+			EXPECT_EQ(count, expected.size());
+			EXPECT_EQ(indices.front(), expected.front().first);
+		}
+	}
+
+	// more neighbors than dataset size
+	HNSW<double, L2Distance> small(4, 10, 10);
+	std::vector<std::vector<double>> small_data = { {0.0, 0.0}, {1.0, 1.0}, {2.0, 2.0} };
+	small.fit(small_data);
+	std::vector<index_t> indices(5, UNDEFINED_INDEX);
+	std::vector<double> query = { 1.9, 1.9 };
+	EXPECT_EQ(small.knn_query_into(query.data(), 5, indices.data(), nullptr, context), 3);
+	EXPECT_EQ(indices, std::vector<index_t>({ 2, 1, 0, UNDEFINED_INDEX, UNDEFINED_INDEX }));
+}
+
+TEST(HNSWTests, HNSWTestNeighborSelectionHeuristic)
+{
+	using Hnsw = HNSW<double, L2Distance>;
+
+	std::vector<std::vector<double>> data = {
+		{1.0, 0.0},
+		{0.0, 1.0},
+		{-1.0, 0.0},
+		{0.0, -1.0}
+	};
+	Hnsw small(/*M*/ 2, /*efConstruction*/ 2, /*efSearch*/ data.size(), Hnsw::NeighborSelection::HEURISTIC,
+		/*extend_candidates*/ true, /*keep_pruned_connections*/ true);
+	small.fit(data);
+	std::vector<double> small_query = { -0.5, -1 };
+	EXPECT_EQ(small.knn_query(small_query, 4), std::vector<index_t>({ 3, 2, 0, 1 }));
+
+	// on clustered data simple selection links elements inside their cluster only, heuristic keeps links between clusters
+	auto clusters = anny::utils::make_clusters<double>(5000, 8, 20, 1.0, -10.0, 10.0);
+	auto queries = anny::utils::make_clusters<double>(5100, 8, 20, 1.0, -10.0, 10.0);
+	queries.erase(queries.begin(), queries.begin() + 5000);
+	VanillaKnn<double, L2Distance> exact;
+	exact.fit(clusters);
+
+	const size_t top_n = 10;
+	auto recall = [&](const Hnsw& alg) {
+		size_t num_found = 0;
+		for (const auto& query : queries)
+		{
+			auto result = alg.knn_query(query, top_n);
+			auto expected = exact.knn_query(query, top_n);
+			for (const auto& i : result)
+				num_found += std::count(expected.begin(), expected.end(), i);
+		}
+		return double(num_found) / (top_n * queries.size());
+	};
+
+	Hnsw simple(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 10);
+	simple.fit(clusters);
+	const double simple_recall = recall(simple);
+
+	for (bool extend_candidates : { false, true })
+	{
+		for (bool keep_pruned_connections : { false, true })
+		{
+			Hnsw alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 10, Hnsw::NeighborSelection::HEURISTIC,
+				extend_candidates, keep_pruned_connections);
+			alg.fit(clusters);
+			const double heuristic_recall = recall(alg);
+			EXPECT_GE(heuristic_recall, 0.9);
+			EXPECT_GE(heuristic_recall, simple_recall);
+		}
+	}
+}
+
+TEST(HNSWTests, HNSWTestParallelBuild)
+{
+	auto data = anny::utils::make_uniform<double>(3000, 8, -10.0, 10.0);
+	auto queries = anny::utils::make_uniform<double>(100, 8, -10.0, 10.0);
+	VanillaKnn<double, L2Distance> exact;
+	exact.fit(data);
+
+	const size_t top_n = 10;
+	for (size_t num_threads : { 1, 2, 4 })
+	{
+		HNSW<double, L2Distance> alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 50);
+		alg.set_num_build_threads(num_threads);
+		EXPECT_EQ(alg.get_num_build_threads(), num_threads);
+		alg.fit(data);
+
+		size_t num_found = 0;
+		for (const auto& query : queries)
+		{
+			auto result = alg.knn_query(query, top_n);
+			ASSERT_EQ(result.size(), top_n);
+			auto expected = exact.knn_query(query, top_n);
+			for (const auto& i : result)
+				num_found += std::count(expected.begin(), expected.end(), i);
+		}
+		EXPECT_GE(num_found, 0.95 * top_n * queries.size()) << num_threads << " threads";  // recall@10
+
+		// every element is reachable
+		for (size_t i = 0; i < data.size(); i += 97)
+			EXPECT_EQ(alg.knn_query(data[i], 1).front(), i);
+	}
+}
+
+TEST(HNSWTests, HNSWTestAddItems)
+{
+	auto data = anny::utils::make_uniform<double>(3000, 8, -10.0, 10.0);
+	auto queries = anny::utils::make_uniform<double>(100, 8, -10.0, 10.0);
+	VanillaKnn<double, L2Distance> exact;
+	exact.fit(data);
+
+	auto rows = [&data](size_t first, size_t last) {
+		std::vector<std::vector<double>> chunk(data.begin() + first, data.begin() + last);
+		return Matrix<double, MatrixStorageVV<double>>(MatrixStorageVV<double>(chunk));
+	};
+	auto check = [&](const HNSW<double, L2Distance>& alg) {
+		const size_t top_n = 10;
+		size_t num_found = 0;
+		for (const auto& query : queries)
+		{
+			auto result = alg.knn_query(query, top_n);
+			auto expected = exact.knn_query(query, top_n);
+			for (const auto& i : result)
+				num_found += std::count(expected.begin(), expected.end(), i);
+		}
+		EXPECT_GE(num_found, 0.95 * top_n * queries.size());  // recall@10
+		for (size_t i = 0; i < data.size(); i += 97)
+			EXPECT_EQ(alg.knn_query(data[i], 1).front(), i);
+	};
+
+	// fit on the first part, then add the rest in chunks of different sizes, one by one and by several threads
+	{
+		HNSW<double, L2Distance> alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 50);
+		std::vector<std::vector<double>> first_part(data.begin(), data.begin() + 1000);
+		alg.fit(first_part);
+		alg.add_items(rows(1000, 1001));
+		alg.add_items(rows(1001, 1500));
+		alg.set_num_build_threads(3);
+		alg.add_items(rows(1500, 2500));
+		alg.set_num_build_threads(1);
+		alg.reserve(3000);
+		for (size_t i = 2500; i < 3000; i += 50)
+			alg.add_items(rows(i, i + 50));
+		EXPECT_EQ(alg.num_elements(), 3000);
+		check(alg);
+
+		EXPECT_THROW(alg.add_items(Matrix<double, MatrixStorageVV<double>>{ { 1.0, 2.0 } }), std::runtime_error);
+		alg.add_items(Matrix<double, MatrixStorageView<double>>());
+		EXPECT_EQ(alg.num_elements(), 3000);
+	}
+
+	// adding to the empty index is the same as fit
+	{
+		HNSW<double, L2Distance> alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 50);
+		alg.reserve(100);
+		alg.add_items(rows(0, 3000));
+		HNSW<double, L2Distance> fitted(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 50);
+		fitted.fit(data);
+		for (const auto& query : queries)
+			EXPECT_EQ(alg.knn_query_with_distances(query, 5), fitted.knn_query_with_distances(query, 5));
+	}
+
+	// borrowed data is copied on the first addition, the caller buffer is not modified
+	{
+		std::vector<double> flat;
+		for (size_t i = 0; i < 2000; i++)
+			flat.insert(flat.end(), data[i].begin(), data[i].end());
+		const auto flat_copy = flat;
+		HNSW<double, L2Distance> alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 50);
+		alg.fit(flat.data(), 2000, 8);
+		alg.add_items(rows(2000, 3000));
+		EXPECT_EQ(flat, flat_copy);
+		check(alg);
+	}
+
+	// borrowed rows are columns [0, 3) of a wider array, the other columns don't take part in distances
+	{
+		std::vector<std::vector<double>> narrow;
+		std::vector<double> wide;
+		for (size_t i = 0; i < 2000; i++)
+		{
+			narrow.emplace_back(data[i].begin(), data[i].begin() + 3);
+			wide.insert(wide.end(), data[i].begin(), data[i].begin() + 3);
+			wide.insert(wide.end(), 5, 100.0 + i);
+		}
+		HNSW<double, L2Distance> alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 50);
+		alg.fit(wide.data(), 2000, 3, 8);
+		VanillaKnn<double, L2Distance> exact_narrow;
+		exact_narrow.fit(narrow);
+		size_t num_found = 0;
+		for (const auto& query : queries)
+		{
+			std::vector<double> q(query.begin(), query.begin() + 3);
+			auto result = alg.knn_query_with_distances(q, 5);
+			auto expected = exact_narrow.knn_query(q, 5);
+			for (const auto& [i, dist] : result)
+			{
+				num_found += std::count(expected.begin(), expected.end(), i);
+				EXPECT_NEAR(dist, L2Distance()(VecView<const double>(narrow[i].data(), 3), VecView<const double>(q.data(), 3)), 1e-9);
+			}
+		}
+		EXPECT_GE(num_found, 0.95 * 5 * queries.size());  // recall@5
+	}
+}
+
+TEST(HNSWTests, HNSWTestDeletion)
+{
+	auto data = anny::utils::make_uniform<double>(3000, 8, -10.0, 10.0);
+	auto queries = anny::utils::make_uniform<double>(100, 8, -10.0, 10.0);
+
+	HNSW<double, L2Distance> alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 50);
+	alg.fit(data);
+
+	// recall@10 against exact search over alive elements
+	auto check = [&]() {
+		std::vector<std::vector<double>> alive_data;
+		std::vector<index_t> alive_indices;
+		for (index_t i = 0; i < data.size(); i++)
+		{
+			if (!alg.is_deleted(i))
+			{
+				alive_data.push_back(data[i]);
+				alive_indices.push_back(i);
+			}
+		}
+		VanillaKnn<double, L2Distance> exact;
+		exact.fit(alive_data);
+
+		const size_t top_n = 10;
+		size_t num_found = 0;
+		for (const auto& query : queries)
+		{
+			auto result = alg.knn_query(query, top_n);
+			ASSERT_EQ(result.size(), top_n);
+			for (const auto& i : result)
+				EXPECT_FALSE(alg.is_deleted(i));
+			for (const auto& i : exact.knn_query(query, top_n))
+				num_found += std::count(result.begin(), result.end(), alive_indices[i]);
+		}
+		EXPECT_GE(num_found, 0.95 * top_n * queries.size());
+		for (size_t i = 0; i < alive_indices.size(); i += 37)
+			EXPECT_EQ(alg.knn_query(data[alive_indices[i]], 1).front(), alive_indices[i]);
+	};
+
+	// deleted elements are not returned, before and after repair
+	for (index_t i = 0; i < data.size(); i += 10)
+		alg.mark_deleted(i);
+	alg.mark_deleted(0);
+	EXPECT_EQ(alg.num_deleted(), 300);
+	EXPECT_TRUE(alg.is_deleted(10));
+	EXPECT_FALSE(alg.is_deleted(11));
+	EXPECT_THROW(alg.mark_deleted(data.size()), std::runtime_error);
+	EXPECT_THROW(alg.is_deleted(data.size()), std::runtime_error);
+	check();
+	alg.repair();
+	EXPECT_EQ(alg.num_deleted(), 300);
+	check();
+
+	// new items take freed slots, the rest are appended
+	auto new_data = anny::utils::make_uniform<double>(400, 8, -9.0, 9.0);  // other points than data from the same generator
+	auto new_indices = alg.add_items(Matrix<double, MatrixStorageVV<double>>(MatrixStorageVV<double>(new_data)));
+	ASSERT_EQ(new_indices.size(), 400);
+	EXPECT_EQ(alg.num_elements(), 3100);
+	EXPECT_EQ(alg.num_deleted(), 0);
+	for (size_t i = 0; i < new_indices.size(); i++)
+	{
+		if (i < 300)
+			EXPECT_EQ(new_indices[i], 10 * i);
+		else
+			EXPECT_EQ(new_indices[i], 3000 + i - 300);
+		EXPECT_EQ(alg.knn_query(new_data[i], 1).front(), new_indices[i]);
+	}
+	for (size_t i = 0; i < new_indices.size(); i++)
+	{
+		if (new_indices[i] < data.size())
+			data[new_indices[i]] = new_data[i];
+		else
+			data.push_back(new_data[i]);
+	}
+	check();
+
+	// most elements deleted, including the entry point
+	for (index_t i = 0; i < data.size(); i++)
+	{
+		if (i % 5 != 0)
+			alg.mark_deleted(i);
+	}
+	check();
+	alg.repair();
+	check();
+
+	// everything deleted, then added again
+	for (index_t i = 0; i < data.size(); i++)
+		alg.mark_deleted(i);
+	EXPECT_TRUE(alg.knn_query(queries[0], 5).empty());
+	alg.repair();
+	EXPECT_TRUE(alg.knn_query(queries[0], 5).empty());
+	alg.add_items(Matrix<double, MatrixStorageVV<double>>(MatrixStorageVV<double>(data)));
+	EXPECT_EQ(alg.num_deleted(), 0);
+	EXPECT_EQ(alg.num_elements(), data.size());
+	check();
+}
+
+TEST(HNSWTests, HNSWTestSaveLoad)
+{
+	using Hnsw = HNSW<double, L2Distance>;
+	const std::string path = (std::filesystem::temp_directory_path() / "anny_hnsw_save_load_test.bin").string();
+
+	auto data = anny::utils::make_uniform<double>(2000, 7, -10.0, 10.0);
+	auto queries = anny::utils::make_uniform<double>(50, 7, -10.0, 10.0);
+	Hnsw alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 30, Hnsw::NeighborSelection::HEURISTIC);
+	alg.fit(data);
+	for (index_t i = 0; i < 100; i++)
+		alg.mark_deleted(i);
+	alg.repair();
+	alg.mark_deleted(100);
+	alg.save(path);
+
+	// loaded index gives the same results, whatever parameters it was created with
+	Hnsw loaded(/*M*/ 4, /*efConstruction*/ 10, /*efSearch*/ 10);
+	loaded.load(path, MappedFile::Advice::RANDOM);
+	EXPECT_EQ(loaded.num_elements(), alg.num_elements());
+	EXPECT_EQ(loaded.num_deleted(), alg.num_deleted());
+	EXPECT_EQ(loaded.get_ef_search(), 30);
+	EXPECT_TRUE(loaded.is_deleted(100));
+	for (const auto& query : queries)
+		EXPECT_EQ(loaded.knn_query_with_distances(query, 10), alg.knn_query_with_distances(query, 10));
+
+	// added items take freed slots and are copied into own memory, the file is not modified
+	auto new_data = anny::utils::make_uniform<double>(150, 7, -9.0, 9.0);
+	auto new_indices = loaded.add_items(Matrix<double, MatrixStorageVV<double>>(MatrixStorageVV<double>(new_data)));
+	EXPECT_EQ(new_indices.front(), 0);
+	EXPECT_EQ(loaded.num_elements(), 2050);
+	for (size_t i = 0; i < new_indices.size(); i++)
+		EXPECT_EQ(loaded.knn_query(new_data[i], 1).front(), new_indices[i]);
+	Hnsw reloaded;
+	reloaded.load(path);
+	EXPECT_EQ(reloaded.num_elements(), 2000);
+	for (const auto& query : queries)
+		EXPECT_EQ(reloaded.knn_query_with_distances(query, 10), alg.knn_query_with_distances(query, 10));
+
+	// empty index
+	Hnsw empty;
+	empty.save(path);
+	reloaded.load(path);
+	EXPECT_EQ(reloaded.num_elements(), 0);
+	EXPECT_TRUE(reloaded.knn_query(queries[0], 5).empty());
+
+	// bad files keep the index as it was
+	alg.save(path);
+	EXPECT_THROW(HNSW<float>().load(path), std::runtime_error);  // element size mismatch
+	EXPECT_THROW((HNSW<double, ManhattanDistance>().load(path)), std::runtime_error);
+	EXPECT_THROW(reloaded.load(path + ".does_not_exist"), std::runtime_error);
+	std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);  // truncated
+	EXPECT_THROW(reloaded.load(path), std::runtime_error);
+	{
+		std::ofstream bad(path, std::ios::binary | std::ios::trunc);
+		bad << std::string(300, 'x');
+	}
+	EXPECT_THROW(reloaded.load(path), std::runtime_error);  // wrong magic
+	EXPECT_EQ(reloaded.num_elements(), 0);
+	EXPECT_THROW(Hnsw(/*M*/ 1), std::runtime_error);  // levels can't be drawn
+	std::filesystem::remove(path);
+}
+
+TEST(HNSWTests, HNSWTestFilteredSearch)
+{
+	auto data = anny::utils::make_uniform<double>(5000, 8, -10.0, 10.0);
+	auto queries = anny::utils::make_uniform<double>(50, 8, -10.0, 10.0);
+	HNSW<double, L2Distance> alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 30);
+	alg.fit(data);
+
+	// recall@10 against exact search over allowed elements, for filters of different selectivity
+	const size_t top_n = 10;
+	for (size_t every : { 2, 10, 100, 1000 })
+	{
+		auto predicate = [every](index_t i) { return i % every == 1; };
+		anny::utils::Bitset bitset(data.size());
+		std::vector<std::vector<double>> allowed_data;
+		std::vector<index_t> allowed_indices;
+		for (index_t i = 0; i < data.size(); i++)
+		{
+			if (predicate(i))
+			{
+				bitset.set(i);
+				allowed_data.push_back(data[i]);
+				allowed_indices.push_back(i);
+			}
+		}
+		VanillaKnn<double, L2Distance> exact;
+		exact.fit(allowed_data);
+
+		size_t num_found = 0;
+		for (const auto& query : queries)
+		{
+			auto result = alg.knn_query_with_distances(query, top_n, bitset);
+			ASSERT_EQ(result.size(), std::min(top_n, allowed_indices.size()));
+			EXPECT_TRUE(std::is_sorted(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.second < b.second; }));
+			for (const auto& [i, dist] : result)
+				EXPECT_TRUE(predicate(i)) << i;
+			EXPECT_EQ(alg.knn_query(query, top_n, predicate), alg.knn_query(query, top_n, bitset));
+			for (const auto& i : exact.knn_query(query, top_n))
+				num_found += std::count_if(result.begin(), result.end(), [&](const auto& el) { return el.first == allowed_indices[i]; });
+		}
+		EXPECT_GE(num_found, 0.95 * std::min(top_n, allowed_indices.size()) * queries.size()) << "every " << every;
+	}
+
+	// deleted elements are filtered out too, the allocation-free path gives the same
+	auto even = [](index_t i) { return i % 2 == 0; };
+	for (index_t i = 0; i < data.size(); i += 4)
+		alg.mark_deleted(i);
+	HNSW<double, L2Distance>::QueryContext context;
+	std::vector<index_t> indices(top_n);
+	for (const auto& query : queries)
+	{
+		auto result = alg.knn_query(query, top_n, even);
+		ASSERT_EQ(result.size(), top_n);
+		for (const auto& i : result)
+			EXPECT_TRUE(even(i) && !alg.is_deleted(i)) << i;
+		ASSERT_EQ(alg.knn_query_into(query.data(), top_n, indices.data(), nullptr, context, even), top_n);
+		EXPECT_EQ(indices, result);
+	}
+
+	// nothing is allowed
+	EXPECT_TRUE(alg.knn_query(queries[0], top_n, anny::utils::Bitset()).empty());
+	EXPECT_TRUE(alg.knn_query(queries[0], top_n, [](index_t) { return false; }).empty());
+}
+
+TEST(HNSWTests, HNSWTestRadiusQuery)
+{
+	std::vector<std::vector<double>> small_data = {
+		{1.0, 0.0},
+		{0.0, 1.0},
+		{-1.0, 0.0},
+		{0.0, -1.0}
+	};
+	HNSW<double, L2Distance> small(/*M*/ 2, /*efConstruction*/ 2, /*efSearch*/ 1);
+	small.fit(small_data);
+	EXPECT_EQ(small.radius_query({ 0.9, 0.0 }, 0.5), std::vector<index_t>({ 0 }));
+	EXPECT_EQ(small.radius_query({ 0.5, 0.5 }, 0.8), std::vector<index_t>({ 0, 1 }));
+	EXPECT_EQ(small.radius_query({ 0.0, 0.0 }, 1.0).size(), 4);
+	EXPECT_TRUE(small.radius_query({ 5.0, 5.0 }, 1.0).empty());
+
+	// clusters of different density, so balls hold from none to hundreds of elements
+	auto data = anny::utils::make_clusters<double>(5000, 8, 20, 1.0, -10.0, 10.0);
+	auto queries = anny::utils::make_clusters<double>(5050, 8, 20, 1.0, -10.0, 10.0);
+	queries.erase(queries.begin(), queries.begin() + 5000);
+	HNSW<double, L2Distance> alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 10, HNSW<double, L2Distance>::NeighborSelection::HEURISTIC);
+	alg.fit(data);
+
+	auto check = [&](const VanillaKnn<double, L2Distance>& exact, const std::vector<index_t>& exact_indices) {
+		for (double radius : { 1.0, 2.0, 4.0 })
+		{
+			size_t num_expected = 0;
+			size_t num_found = 0;
+			for (const auto& query : queries)
+			{
+				auto result = alg.radius_query_with_distances(query, radius);
+				EXPECT_TRUE(std::is_sorted(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.second < b.second; }));
+				for (const auto& [i, dist] : result)
+				{
+					EXPECT_LE(dist, radius);
+					EXPECT_NEAR(dist, l2_distance(VecView<const double>(data[i].data(), 8), VecView<const double>(query.data(), 8)), 1e-9);
+					EXPECT_FALSE(alg.is_deleted(i));
+				}
+				auto expected = exact.radius_query(query, radius);
+				num_expected += expected.size();
+				for (const auto& i : expected)
+					num_found += std::count_if(result.begin(), result.end(), [&](const auto& el) { return el.first == exact_indices[i]; });
+			}
+			EXPECT_GE(num_found, 0.97 * num_expected) << "radius " << radius;
+		}
+	};
+
+	VanillaKnn<double, L2Distance> exact;
+	exact.fit(data);
+	std::vector<index_t> all_indices(data.size());
+	std::iota(all_indices.begin(), all_indices.end(), 0);
+	check(exact, all_indices);
+
+	// deleted elements are expanded, but not returned
+	std::vector<std::vector<double>> alive_data;
+	std::vector<index_t> alive_indices;
+	for (index_t i = 0; i < data.size(); i++)
+	{
+		if (i % 3 == 0)
+		{
+			alg.mark_deleted(i);
+			continue;
+		}
+		alive_data.push_back(data[i]);
+		alive_indices.push_back(i);
+	}
+	VanillaKnn<double, L2Distance> exact_alive;
+	exact_alive.fit(alive_data);
+	check(exact_alive, alive_indices);
+}
+
+TEST(HNSWTests, HNSWTestReorder)
+{
+	using Hnsw = HNSW<double, L2Distance>;
+	const std::string path = (std::filesystem::temp_directory_path() / "anny_hnsw_reorder_test.bin").string();
+
+	auto data = anny::utils::make_uniform<double>(3000, 8, -10.0, 10.0);
+	auto queries = anny::utils::make_uniform<double>(50, 8, -10.0, 10.0);
+	Hnsw alg(/*M*/ 8, /*efConstruction*/ 50, /*efSearch*/ 30);
+	alg.fit(data);
+	for (index_t i = 0; i < 50; i++)
+		alg.mark_deleted(i);
+	alg.repair();
+	alg.mark_deleted(100);
+
+	auto predicate = [](index_t i) { return i % 10 == 3; };
+	auto bitset = anny::utils::Bitset::from_indices(std::vector<index_t>{ 200, 1500, 2999 });
+	auto results = [&](const Hnsw& hnsw) {
+		std::vector<Hnsw::KnnResult> result;
+		for (const auto& query : queries)
+		{
+			result.push_back(hnsw.knn_query_with_distances(query, 10));
+			result.push_back(hnsw.knn_query_with_distances(query, 10, predicate));
+			result.push_back(hnsw.knn_query_with_distances(query, 10, bitset));
+			result.push_back(hnsw.radius_query_with_distances(query, 6.0));
+		}
+		return result;
+	};
+
+	// the same elements are found under the same indices
+	const auto expected = results(alg);
+	alg.reorder();
+	EXPECT_EQ(results(alg), expected);
+	alg.reorder();
+	EXPECT_EQ(results(alg), expected);
+	EXPECT_TRUE(alg.is_deleted(100));
+	EXPECT_FALSE(alg.is_deleted(101));
+
+	// reordered index is saved with its indices
+	alg.save(path);
+	Hnsw loaded;
+	loaded.load(path);
+	EXPECT_EQ(results(loaded), expected);
+	EXPECT_TRUE(loaded.is_deleted(100));
+	std::filesystem::remove(path);
+
+	// added items take indices of freed elements first, then the next ones
+	alg.mark_deleted(101);
+	auto new_data = anny::utils::make_uniform<double>(60, 8, -9.0, 9.0);
+	auto new_indices = alg.add_items(Matrix<double, MatrixStorageVV<double>>(MatrixStorageVV<double>(new_data)));
+	std::vector<index_t> expected_indices(60);
+	std::iota(expected_indices.begin(), expected_indices.begin() + 50, 0);
+	std::iota(expected_indices.begin() + 50, expected_indices.end(), 3000);
+	std::vector<index_t> sorted_indices(new_indices);
+	std::sort(sorted_indices.begin(), sorted_indices.end());
+	EXPECT_EQ(sorted_indices, expected_indices);
+	for (size_t i = 0; i < new_indices.size(); i++)
+		EXPECT_EQ(alg.knn_query(new_data[i], 1).front(), new_indices[i]);
+	EXPECT_TRUE(alg.is_deleted(101));
+	for (const auto& query : queries)
+	{
+		auto result = alg.knn_query(query, 10);
+		EXPECT_EQ(std::count(result.begin(), result.end(), 101), 0);
+	}
+}
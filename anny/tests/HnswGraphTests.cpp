@@ -0,0 +1,133 @@
+#include <memory>
+#include <vector>
+#include <gtest/gtest.h>
+#include "core/hnsw_graph.h"
+
+using namespace anny;
+
+
+static std::vector<HnswGraph::id_t> to_vector(HnswGraph::Links links)
+{
+    return std::vector<HnswGraph::id_t>(links.begin(), links.end());
+}
+
+
+TEST(HnswGraphTests, LevelsTest)
+{
+    HnswGraph g(4, 2);
+    EXPECT_EQ(g.num_nodes(), 0);
+    g.resize(5);
+    EXPECT_EQ(g.num_nodes(), 5);
+    EXPECT_EQ(g.max_links(0), 4);
+    EXPECT_EQ(g.max_links(1), 2);
+    EXPECT_EQ(g.max_links(3), 2);
+
+    EXPECT_EQ(g.level(0), -1);
+    g.set_level(0, 0);
+    g.set_level(1, 2);
+    EXPECT_EQ(g.level(0), 0);
+    EXPECT_EQ(g.level(1), 2);
+    EXPECT_TRUE(g.links(1, 0).empty());
+    EXPECT_TRUE(g.links(1, 2).empty());
+
+    g.resize(7);
+    EXPECT_EQ(g.level(6), -1);
+    EXPECT_EQ(g.level(1), 2);
+}
+
+TEST(HnswGraphTests, LinksTest)
+{
+    HnswGraph g(3, 2);
+    g.resize(4);
+    g.set_level(0, 1);
+    g.set_level(1, 2);
+    g.set_level(2, 0);
+    g.set_level(3, 1);
+
+    g.set_links(0, 0, std::vector<int>{ 1, 2 });
+    EXPECT_EQ(to_vector(g.links(0, 0)), std::vector<HnswGraph::id_t>({ 1, 2 }));
+    EXPECT_TRUE(g.add_link(0, 0, 3));
+    EXPECT_FALSE(g.add_link(0, 0, 3));
+    EXPECT_EQ(g.links(0, 0).size(), 3);
+    EXPECT_EQ(g.links(0, 0)[2], 3);
+
+    // upper level blocks of different nodes do not overlap
+    g.set_links(0, 1, std::vector<int>{ 1, 3 });
+    g.set_links(1, 1, std::vector<int>{ 0 });
+    g.set_links(1, 2, std::vector<int>{ 3, 0 });
+    g.set_links(3, 1, std::vector<int>{ 1 });
+    EXPECT_FALSE(g.add_link(0, 1, 2));
+    EXPECT_TRUE(g.add_link(3, 1, 0));
+    EXPECT_EQ(to_vector(g.links(0, 1)), std::vector<HnswGraph::id_t>({ 1, 3 }));
+    EXPECT_EQ(to_vector(g.links(1, 1)), std::vector<HnswGraph::id_t>({ 0 }));
+    EXPECT_EQ(to_vector(g.links(1, 2)), std::vector<HnswGraph::id_t>({ 3, 0 }));
+    EXPECT_EQ(to_vector(g.links(3, 1)), std::vector<HnswGraph::id_t>({ 1, 0 }));
+    EXPECT_TRUE(g.links(2, 0).empty());
+
+    // replacing links makes the list shorter
+    g.set_links(0, 0, std::vector<int>{ 2 });
+    EXPECT_EQ(to_vector(g.links(0, 0)), std::vector<HnswGraph::id_t>({ 2 }));
+}
+
+TEST(HnswGraphTests, AttachTest)
+{
+    HnswGraph g(4, 2);
+    g.resize(3);
+    g.set_level(0, 0);
+    g.set_level(1, 1);
+    g.set_level(2, 2);
+    g.set_links(0, 0, std::vector<int>{ 1, 2 });
+    g.set_links(1, 1, std::vector<int>{ 2 });
+    g.set_links(2, 2, std::vector<int>{ 1 });
+
+    // arrays copied into one buffer, like sections of a file
+    auto pack = [&g](std::vector<char>& buffer) {
+        HnswGraph::RawArrays arrays = g.raw_arrays();
+        std::vector<size_t> offsets;
+        for (const auto& array : arrays)
+        {
+            buffer.resize((buffer.size() + 7) / 8 * 8);  // keeps 64-bit offsets aligned
+            offsets.push_back(buffer.size());
+            const char* data = static_cast<const char*>(array.data);
+            buffer.insert(buffer.end(), data, data + array.size);
+        }
+        for (size_t i = 0; i < arrays.size(); i++)
+            arrays[i].data = buffer.data() + offsets[i];
+        return arrays;
+    };
+    auto buffer = std::make_shared<std::vector<char>>();
+    HnswGraph::RawArrays arrays = pack(*buffer);
+
+    // corrupt levels, offsets and links throw instead of reading out of bounds later
+    auto corrupt = [&](size_t array, size_t index, auto value) {
+        auto copy = std::make_shared<std::vector<char>>();
+        HnswGraph::RawArrays copy_arrays = pack(*copy);
+        static_cast<decltype(value)*>(const_cast<void*>(copy_arrays[array].data))[index] = value;
+        HnswGraph corrupted;
+        EXPECT_THROW(corrupted.attach(4, 2, copy_arrays, copy), std::runtime_error);
+    };
+    corrupt(0, 2, HnswGraph::MAX_LEVEL + 1);  // level of node 2
+    corrupt(1, 2, uint64_t{ 1000 });  // upper offset of node 2
+    corrupt(2, 0, HnswGraph::id_t{ 5 });  // links count of node 0 at level 0
+    corrupt(2, 1, HnswGraph::id_t{ 3 });  // link of node 0 to no node
+
+    HnswGraph attached;
+    attached.attach(4, 2, arrays, buffer);
+    ASSERT_EQ(attached.num_nodes(), 3);
+    EXPECT_EQ(to_vector(attached.links(0, 0)), std::vector<HnswGraph::id_t>({ 1, 2 }));
+    EXPECT_EQ(to_vector(attached.links(2, 2)), std::vector<HnswGraph::id_t>({ 1 }));
+
+    // links are changed in place, growing copies them into own memory first
+    attached.set_links(1, 0, std::vector<int>{ 2 });
+    attached.resize(4);
+    attached.set_level(3, 1);
+    attached.set_links(3, 1, std::vector<int>{ 1 });
+    std::fill(buffer->begin(), buffer->end(), 0);
+    EXPECT_EQ(to_vector(attached.links(0, 0)), std::vector<HnswGraph::id_t>({ 1, 2 }));
+    EXPECT_EQ(to_vector(attached.links(1, 0)), std::vector<HnswGraph::id_t>({ 2 }));
+    EXPECT_EQ(to_vector(attached.links(1, 1)), std::vector<HnswGraph::id_t>({ 2 }));
+    EXPECT_EQ(to_vector(attached.links(3, 1)), std::vector<HnswGraph::id_t>({ 1 }));
+
+    arrays[2].size -= 4;
+    EXPECT_THROW(attached.attach(4, 2, arrays, buffer), std::runtime_error);
+}
@@ -1,7 +1,9 @@
 #include <iostream>
 #include <gtest/gtest.h>
 #include "algs/kdtree.h"
+#include "algs/vanilla_knn.h"
 #include "utils/csv_loader.h"
+#include "utils/dataset_creator.h"
 
 using namespace anny;
 
@@ -143,3 +145,76 @@ TEST(KDTreeTests, KDTreeTestIris)
 
 }
 
+
+TEST(KDTreeTests, KDTreeTestInnerProduct)
+{
+	auto data = anny::utils::make_uniform<double>(500, 4, -10.0, 10.0);
+
+	KDTree<double, InnerProductDistance> alg(10);
+	alg.fit(data);
+	VanillaKnn<double, InnerProductDistance> exact;
+	exact.fit(data);
+
+	auto queries = anny::utils::make_uniform<double>(20, 4, -1.0, 1.0);
+	for (const auto& query : queries)
+	{
+		EXPECT_EQ(alg.knn_query(query, 10), exact.knn_query(query, 10));
+
+		auto expected = exact.radius_query(query, -20.0);  // all points with dot(query, x) >= 21
+		auto result = alg.radius_query(query, -20.0);
+		std::sort(expected.begin(), expected.end());
+		std::sort(result.begin(), result.end());
+		EXPECT_EQ(result, expected);
+	}
+
+	KDTree<double, InnerProductDistance> empty(10);
+	EXPECT_NO_THROW(empty.fit(std::vector<std::vector<double>>{}));
+}
+
+template <typename T, typename Dist>
+void check_kdtree_is_exact(const std::vector<std::vector<T>>& data, const std::vector<std::vector<T>>& queries, T radius)
+{
+	KDTree<T, Dist> alg(10);
+	alg.fit(data);
+	VanillaKnn<T, Dist> exact;
+	exact.fit(data);
+
+	for (const auto& query : queries)
+	{
+		// compare sets of neighbors, because ties are ordered arbitrarily
+		auto expected = exact.knn_query(query, 10);
+		auto result = alg.knn_query(query, 10);
+		auto worst = Dist()(Vec<T>(query).view(), Vec<T>(data[expected.back()]).view());
+		EXPECT_EQ(Dist()(Vec<T>(query).view(), Vec<T>(data[result.back()]).view()), worst);
+
+		expected = exact.radius_query(query, radius);
+		result = alg.radius_query(query, radius);
+		std::sort(expected.begin(), expected.end());
+		std::sort(result.begin(), result.end());
+		EXPECT_EQ(result, expected);
+	}
+}
+
+TEST(KDTreeTests, KDTreeTestOtherMetrics)
+{
+	auto data = anny::utils::make_uniform<double>(500, 4, -10.0, 10.0);
+	auto queries = anny::utils::make_uniform<double>(20, 4, -10.0, 10.0);
+	check_kdtree_is_exact<double, ManhattanDistance>(data, queries, 5.0);
+	check_kdtree_is_exact<double, ChebyshevDistance>(data, queries, 3.0);
+
+	// coordinate differences below 1 have squares below themselves, the bound of squared L2 is squared too
+	auto small_data = anny::utils::make_uniform<double>(500, 4, -0.5, 0.5);
+	auto small_queries = anny::utils::make_uniform<double>(20, 4, -0.5, 0.5);
+	check_kdtree_is_exact<double, L2SquaredDistance>(small_data, small_queries, 0.05);
+
+	// binary fingerprints of 128 bits
+	std::default_random_engine gen;
+	std::uniform_int_distribution<uint64_t> dis;
+	std::vector<std::vector<uint64_t>> codes(500, std::vector<uint64_t>(2));
+	std::vector<std::vector<uint64_t>> code_queries(20, std::vector<uint64_t>(2));
+	for (auto& code : codes)
+		std::generate(code.begin(), code.end(), [&]() { return dis(gen); });
+	for (auto& code : code_queries)
+		std::generate(code.begin(), code.end(), [&]() { return dis(gen); });
+	check_kdtree_is_exact<uint64_t, HammingDistance>(codes, code_queries, 50);
+}
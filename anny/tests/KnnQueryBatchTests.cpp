@@ -0,0 +1,182 @@
+#include <iostream>
+#include <gtest/gtest.h>
+#include "algs/vanilla_knn.h"
+#include "algs/kdtree.h"
+#include "algs/annoy.h"
+#include "algs/hnsw.h"
+#include "core/distance.h"
+#include "utils/dataset_creator.h"
+
+using namespace anny;
+
+namespace
+{
+	Matrix<double> to_matrix(const std::vector<std::vector<double>>& rows)
+	{
+		Matrix<double> m(rows.size(), rows[0].size());
+		for (size_t i = 0; i < rows.size(); i++)
+			std::copy(rows[i].begin(), rows[i].end(), m[i].begin());
+		return m;
+	}
+
+	// batch result must be the same as separate queries, with distances of Dist to the found points
+	template <typename Dist>
+	void check_knn_query_batch(IKnnAlgorithm<double>& alg, const std::vector<std::vector<double>>& data,
+		const std::vector<std::vector<double>>& queries, size_t k)
+	{
+		Matrix<double> q = to_matrix(queries);
+		Dist dist;
+		for (size_t num_threads : { 1, 4 })
+		{
+			auto result = alg.knn_query_batch(q, k, num_threads);
+			ASSERT_EQ(result.num_queries, queries.size());
+			ASSERT_EQ(result.k, k);
+			ASSERT_EQ(result.indices.size(), queries.size() * k);
+			ASSERT_EQ(result.distances.size(), queries.size() * k);
+
+			for (size_t i = 0; i < queries.size(); i++)
+			{
+				auto expected = alg.knn_query(queries[i], k);
+				for (size_t j = 0; j < k; j++)
+				{
+					if (j >= expected.size())
+					{
+						EXPECT_EQ(result.index(i, j), UNDEFINED_INDEX);
+						continue;
+					}
+					EXPECT_EQ(result.index(i, j), expected[j]);
+					Vec<double> x(data[expected[j]]);
+					Vec<double> y(queries[i]);
+					EXPECT_NEAR(result.distance(i, j), dist(x.view(), y.view()), 1e-9);
+					if (j > 0)
+					{
+						EXPECT_LE(result.distance(i, j - 1), result.distance(i, j) + 1e-9);
+					}
+				}
+			}
+		}
+	}
+
+	// query variants with distances must give the same neighbors as plain queries, with distances of Dist
+	template <typename Dist>
+	void check_query_with_distances(const IKnnAlgorithm<double>& alg, const std::vector<std::vector<double>>& data,
+		const std::vector<std::vector<double>>& queries, size_t k, double radius, bool with_radius = true)
+	{
+		Dist dist;
+		auto check = [&](const std::vector<double>& query, const IKnnAlgorithm<double>::KnnResult& result, const IndexVector& expected) {
+			ASSERT_EQ(result.size(), expected.size());
+			for (size_t j = 0; j < result.size(); j++)
+			{
+				EXPECT_EQ(result[j].first, expected[j]);
+				Vec<double> x(data[result[j].first]);
+				Vec<double> y(query);
+				EXPECT_NEAR(result[j].second, dist(x.view(), y.view()), 1e-9);
+			}
+		};
+
+		for (const auto& query : queries)
+		{
+			check(query, alg.knn_query_with_distances(query, k), alg.knn_query(query, k));
+			if (with_radius)
+			{
+				auto result = alg.radius_query_with_distances(query, radius);
+				check(query, result, alg.radius_query(query, radius));
+				for (const auto& [index, d] : result)
+					EXPECT_LE(d, radius + 1e-9);
+			}
+		}
+	}
+}
+
+TEST(KnnQueryBatchTests, QueryWithDistancesAllAlgorithms)
+{
+	std::vector<anny::utils::GaussianCluster<double>> clusters = {
+		{{-5, -5, 0}, 1.0, 100},
+		{{5, 5, 1}, 2.0, 100}
+	};
+	auto data = anny::utils::make_clusters<double>(clusters, -100.0, 100.0);
+	std::vector<std::vector<double>> queries(data.begin(), data.begin() + 20);
+	queries.push_back({ 0.0, 0.0, 0.0 });
+
+	{
+		VanillaKnn<double, L2Distance> alg;
+		alg.fit(data);
+		check_query_with_distances<L2Distance>(alg, data, queries, 5, 1.5);
+	}
+	{
+		VanillaKnn<double, CosineDistance> alg;
+		alg.fit(data);
+		check_query_with_distances<CosineDistance>(alg, data, queries, 5, 0.01);
+	}
+	{
+		KDTree<double, L2Distance> alg(10);
+		alg.fit(data);
+		check_query_with_distances<L2Distance>(alg, data, queries, 5, 1.5);
+	}
+	{
+		KDTree<double, InnerProductDistance> alg(10);
+		alg.fit(data);
+		check_query_with_distances<InnerProductDistance>(alg, data, queries, 5, -20.0);
+	}
+	{
+		Annoy<double, L2Distance> alg(10, 5);
+		alg.fit(data);
+		check_query_with_distances<L2Distance>(alg, data, queries, 5, 1.5);
+	}
+	{
+		Annoy<double, InnerProductDistance> alg(10, 5);
+		alg.fit(data);
+		check_query_with_distances<InnerProductDistance>(alg, data, queries, 5, -20.0);
+	}
+	{
+		HNSW<double, L2Distance> alg(8, 50, 50);
+		alg.fit(data);
+		check_query_with_distances<L2Distance>(alg, data, queries, 5, 0.0, /*with_radius*/ false);
+	}
+}
+
+TEST(KnnQueryBatchTests, KnnQueryBatchAllAlgorithms)
+{
+	std::vector<anny::utils::GaussianCluster<double>> clusters = {
+		{{-5, -5, 0}, 1.0, 100},
+		{{5, 5, 1}, 2.0, 100}
+	};
+	auto data = anny::utils::make_clusters<double>(clusters, -100.0, 100.0);
+	std::vector<std::vector<double>> queries(data.begin(), data.begin() + 50);
+	queries.push_back({ 0.0, 0.0, 0.0 });
+	queries.push_back({ 100.0, -100.0, 3.0 });
+
+	{
+		VanillaKnn<double, L2Distance> alg;
+		alg.fit(data);
+		check_knn_query_batch<L2Distance>(alg, data, queries, 5);
+		check_knn_query_batch<L2Distance>(alg, data, queries, data.size() + 3);  // more than dataset size
+	}
+	{
+		KDTree<double, L2Distance> alg(10);
+		alg.fit(data);
+		check_knn_query_batch<L2Distance>(alg, data, queries, 5);
+	}
+	{
+		KDTree<double, InnerProductDistance> alg(10);
+		alg.fit(data);
+		check_knn_query_batch<InnerProductDistance>(alg, data, queries, 5);
+	}
+	{
+		Annoy<double, L2Distance> alg(10, 5);
+		alg.fit(data);
+		check_knn_query_batch<L2Distance>(alg, data, queries, 5);
+	}
+	{
+		HNSW<double, L2Distance> alg(8, 50, 50);
+		alg.fit(data);
+		check_knn_query_batch<L2Distance>(alg, data, queries, 5);
+	}
+	{
+		HNSW<double, L2Distance> alg;
+		alg.fit(data);
+		auto result = alg.knn_query_batch(Matrix<double>(0, 3), 5);
+		EXPECT_EQ(result.num_queries, 0);
+		EXPECT_TRUE(result.indices.empty());
+	}
+}
@@ -1,8 +1,12 @@
 #include <iostream>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
 #include "core/vec.h"
 #include "core/vec_view.h"
 #include "core/matrix.h"
+#include "core/matrix_mmap.h"
+#include "core/distance.h"
 
 using namespace anny;
 
@@ -131,3 +135,205 @@ TEST(MatrixTests, MatrixCalcTest0)
 }
 
 
+
+TEST(MatrixTests, MatrixStorageAlignedTest)
+{
+    MatrixStorageAligned<float> m = {
+        {1, 2, 3},
+        {4, 5, 6}
+    };
+    EXPECT_EQ(m.shape(), Shape(2, 3));
+    EXPECT_EQ(m.row_stride(), 16);  // 64 bytes
+    Vec<float> row = { 4, 5, 6 };
+    EXPECT_EQ(m[1], row.view());
+    EXPECT_EQ(m(1, 2), 6);
+
+    // rows are cache line aligned and padded with zeros
+    for (size_t i = 0; i < m.num_rows(); i++)
+    {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(m[i].begin()) % MatrixStorageAligned<float>::ROW_ALIGNMENT, 0);
+        for (size_t j = m.num_cols(); j < m.row_stride(); j++)
+            EXPECT_EQ(m.data()[i * m.row_stride() + j], 0.0f);
+    }
+
+    EXPECT_EQ(MatrixStorageAligned<double>::padded_size(8), 8);
+    EXPECT_EQ(MatrixStorageAligned<double>::padded_size(9), 16);
+    EXPECT_EQ(MatrixStorageAligned<uint8_t>(2, 100).row_stride(), 128);
+
+    // copy is deep
+    auto copy = m;
+    EXPECT_EQ(copy, m);
+    copy(0, 0) = 100;
+    EXPECT_NE(copy, m);
+    EXPECT_NE(copy.data(), m.data());
+
+    std::vector<std::vector<float>> data = { {1, 2}, {3, 4}, {5, 6} };
+    Matrix<float, MatrixStorageAligned<float>> matrix{ MatrixStorageAligned<float>(data) };
+    EXPECT_EQ(matrix.shape(), Shape(3, 2));
+    EXPECT_EQ(matrix(2, 1), 6);
+    EXPECT_EQ(matrix.storage().row_stride(), 16);
+}
+
+TEST(MatrixTests, MatrixStorageMmapTest)
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "anny_matrix_mmap_test.bin").string();
+
+    Matrix<float> m(5, 3);
+    for (size_t i = 0; i < m.num_rows(); i++)
+        for (size_t j = 0; j < m.num_cols(); j++)
+            m(i, j) = static_cast<float>(10 * i + j);
+
+    for (bool pad_rows : { true, false })
+    {
+        MatrixStorageMmap<float>::write(path, m, pad_rows);
+        MatrixStorageMmap<float> mapped(path, MatrixStorageMmap<float>::Advice::SEQUENTIAL);
+        EXPECT_EQ(mapped.shape(), m.shape());
+        EXPECT_EQ(mapped.row_stride(), pad_rows ? 16 : 3);
+        for (size_t i = 0; i < m.num_rows(); i++)
+            EXPECT_EQ(mapped[i], m[i]);
+        if (pad_rows)
+        {
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(mapped[1].begin()) % 64, 0);
+        }
+
+        mapped.advise(MatrixStorageMmap<float>::Advice::RANDOM);
+        mapped.advise(MatrixStorageMmap<float>::Advice::WILLNEED, 1, 3);
+
+        // mapping is read-only: a write faults instead of silently copying the page
+        EXPECT_DEATH(mapped(0, 0) = 42.0f, "");
+        EXPECT_EQ(mapped(0, 0), 0.0f);
+
+        // storage of a Matrix: the same interface as other storages
+        Matrix<float, MatrixStorageMmap<float>> matrix(std::move(mapped));
+        EXPECT_EQ(mapped.num_rows(), 0);
+        EXPECT_EQ(matrix(4, 2), 42.0f);
+        std::vector<float> out;
+        Vec<float> q = { 0.0f, 0.0f, 0.0f };
+        distance_batch<L2SquaredDistance>(q.view(), matrix, 1, 3, out);
+        EXPECT_EQ(out, std::vector<float>({ 100.0f + 121.0f + 144.0f, 400.0f + 441.0f + 484.0f }));
+    }
+
+    EXPECT_THROW(MatrixStorageMmap<double>{ path }, std::runtime_error);  // element size mismatch
+    EXPECT_THROW(MatrixStorageMmap<float>{ path + ".does_not_exist" }, std::runtime_error);
+
+    // rows of a foreign file starting off the cache line are rejected
+    MatrixStorageMmap<float>::write(path, m);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) + 64);
+    {
+        std::fstream patched(path, std::ios::binary | std::ios::in | std::ios::out);
+        const uint64_t data_offset = sizeof(MatrixFileHeader) + sizeof(float);
+        patched.seekp(offsetof(MatrixFileHeader, data_offset));
+        patched.write(reinterpret_cast<const char*>(&data_offset), sizeof(data_offset));
+    }
+    EXPECT_THROW(MatrixStorageMmap<float>{ path }, std::runtime_error);
+
+    std::filesystem::resize_file(path, 100);  // truncated
+    EXPECT_THROW(MatrixStorageMmap<float>{ path }, std::runtime_error);
+
+    {
+        std::ofstream bad(path, std::ios::binary | std::ios::trunc);
+        bad << std::string(200, 'x');
+    }
+    EXPECT_THROW(MatrixStorageMmap<float>{ path }, std::runtime_error);  // wrong magic
+    std::filesystem::remove(path);
+}
+
+TEST(MatrixTests, MatrixStorageViewTest)
+{
+    // contiguous storage from a flat vector
+    MatrixStorageContiguous<float> contiguous(std::vector<float>{ 1, 2, 3, 4, 5, 6 }, 3);
+    EXPECT_EQ(contiguous.shape(), Shape(2, 3));
+    EXPECT_EQ(contiguous(1, 0), 4.0f);
+
+    // adopted storage: the same memory, no copy
+    const float* contiguous_data = contiguous.data();
+    MatrixStorageView<float> adopted(std::move(contiguous));
+    EXPECT_TRUE(adopted.owns_data());
+    EXPECT_EQ(adopted.data(), contiguous_data);
+    EXPECT_EQ(adopted.shape(), Shape(2, 3));
+    EXPECT_EQ(adopted.row_stride(), 3);
+
+    // copies share memory, clone doesn't
+    MatrixStorageView<float> shared = adopted;
+    MatrixStorageView<float> cloned = adopted.clone();
+    shared(0, 0) = 10.0f;
+    EXPECT_EQ(adopted(0, 0), 10.0f);
+    EXPECT_EQ(cloned(0, 0), 1.0f);
+    EXPECT_EQ(cloned.row_stride(), 16);
+    EXPECT_NE(cloned, adopted);
+    cloned(0, 0) = 10.0f;
+    EXPECT_EQ(cloned, adopted);
+
+    // borrowed memory with a row stride
+    std::vector<float> raw = { 1, 2, 0, 3, 4, 0 };
+    MatrixStorageView<float> borrowed(raw.data(), 2, 2, 3);
+    EXPECT_FALSE(borrowed.owns_data());
+    EXPECT_EQ(borrowed[1], Vec<float>({ 3, 4 }).view());
+
+    // matrix over a view, storage released from another matrix
+    Matrix<float, MatrixStorageAligned<float>> aligned = { {1, 2}, {3, 4} };
+    Matrix<float, MatrixStorageView<float>> m(MatrixStorageView<float>(aligned.release()));
+    EXPECT_EQ(m(1, 1), 4.0f);
+    EXPECT_EQ(m.storage().row_stride(), 16);
+    Matrix<float, MatrixStorageView<float>> zeros(2, 5);
+    EXPECT_TRUE(zeros.storage().owns_data());
+    EXPECT_EQ(zeros(1, 4), 0.0f);
+}
+
+TEST(MatrixTests, MatrixStorageViewAppendTest)
+{
+    auto append = [](auto& storage, const std::vector<float>& row) {
+        storage.push_back(VecView<const float>(row.data(), row.size()));
+    };
+
+    // empty storage takes number of columns from the first row, capacity doubles
+    MatrixStorageView<float> view;
+    EXPECT_EQ(view.capacity(), 0);
+    append(view, { 1, 2 });
+    EXPECT_EQ(view.shape(), Shape(1, 2));
+    EXPECT_TRUE(view.owns_data());
+    append(view, { 3, 4 });
+    append(view, { 5, 6 });
+    EXPECT_EQ(view.shape(), Shape(3, 2));
+    EXPECT_EQ(view.capacity(), 4);
+    EXPECT_EQ(view[2], Vec<float>({ 5, 6 }).view());
+
+    // reserved rows are filled without reallocation
+    view.reserve(10);
+    EXPECT_EQ(view.capacity(), 10);
+    const float* data = view.data();
+    for (float i = 0; i < 7; i++)
+        append(view, { i, -i });
+    EXPECT_EQ(view.data(), data);
+    EXPECT_EQ(view.num_rows(), 10);
+    EXPECT_EQ(view(0, 1), 2.0f);
+    EXPECT_EQ(view(9, 1), -6.0f);
+    view.reserve(5);
+    EXPECT_EQ(view.capacity(), 10);
+
+    // appending to a shared storage moves it to new memory, the other copy is not affected
+    MatrixStorageView<float> shared = view;
+    append(view, { 7, 8 });
+    EXPECT_NE(view.data(), data);
+    EXPECT_EQ(shared.data(), data);
+    EXPECT_EQ(shared.num_rows(), 10);
+    EXPECT_EQ(view.num_rows(), 11);
+    EXPECT_EQ(view[10], Vec<float>({ 7, 8 }).view());
+    EXPECT_EQ(view[3], shared[3]);
+
+    // borrowed memory is never written
+    std::vector<float> raw = { 1, 2, 3, 4 };
+    MatrixStorageView<float> borrowed(raw.data(), 2, 2);
+    EXPECT_EQ(borrowed.capacity(), 2);
+    append(borrowed, { 5, 6 });
+    EXPECT_TRUE(borrowed.owns_data());
+    EXPECT_EQ(borrowed.num_rows(), 3);
+    EXPECT_EQ(borrowed(1, 1), 4.0f);
+    EXPECT_EQ(raw, std::vector<float>({ 1, 2, 3, 4 }));
+
+    // rows are appended to a matrix through its storage
+    Matrix<float, MatrixStorageView<float>> m(1, 2);
+    append(m, { 3, 4 });
+    EXPECT_EQ(m.num_rows(), 2);
+    EXPECT_EQ(m[1], Vec<float>({ 3, 4 }).view());
+}
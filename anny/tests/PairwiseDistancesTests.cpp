@@ -0,0 +1,100 @@
+#include <random>
+#include <gtest/gtest.h>
+#include "core/matrix.h"
+#include "core/distance.h"
+#include "core/gemm.h"
+#include "core/pairwise_distances.h"
+
+using namespace anny;
+
+
+template <typename T>
+Matrix<T> make_random_matrix(size_t rows, size_t cols, unsigned seed)
+{
+    std::default_random_engine gen(seed);
+    std::uniform_real_distribution<T> dis{ T{ -1 }, T{ 1 } };
+    Matrix<T> m(rows, cols);
+    for (size_t i = 0; i < rows; i++)
+        for (size_t j = 0; j < cols; j++)
+            m(i, j) = dis(gen);
+    return m;
+}
+
+template <typename T>
+void check_gemm_nt(size_t M, size_t N, size_t K)
+{
+    auto A = make_random_matrix<T>(M, K, 1);
+    auto B = make_random_matrix<T>(N, K, 2);
+    std::vector<T> C(M * N, T{ 42 });  // must be overwritten
+
+    const auto best = simd::detect_instruction_set();
+    for (int isa = 0; isa <= static_cast<int>(best); isa++)
+    {
+        simd::set_instruction_set(static_cast<simd::InstructionSet>(isa));
+        gemm::gemm_nt_blocked(M, N, K, A[0].cbegin(), K, B[0].cbegin(), K, C.data(), N);
+        for (size_t i = 0; i < M; i++)
+            for (size_t j = 0; j < N; j++)
+                EXPECT_NEAR(C[i * N + j], simd::detail::dot_scalar(A[i].cbegin(), B[j].cbegin(), K), T{ 1e-4 } * (1 + K));
+    }
+    simd::set_instruction_set(best);
+
+    gemm::gemm_nt(M, N, K, A[0].cbegin(), K, B[0].cbegin(), K, C.data(), N);
+    EXPECT_NEAR(C[(M - 1) * N + N - 1], simd::detail::dot_scalar(A[M - 1].cbegin(), B[N - 1].cbegin(), K), T{ 1e-4 } * (1 + K));
+}
+
+TEST(PairwiseDistancesTests, GemmTest)
+{
+    // sizes below, equal to and above register tiles and cache blocks
+    check_gemm_nt<float>(1, 1, 1);
+    check_gemm_nt<float>(7, 33, 5);
+    check_gemm_nt<float>(80, 300, 270);
+    check_gemm_nt<double>(13, 17, 19);
+    check_gemm_nt<double>(75, 260, 3);
+}
+
+template <typename Dist, typename T>
+void check_pairwise_distances(const Matrix<T>& Q, const Matrix<T>& X, size_t num_threads)
+{
+    auto D = pairwise_distances<Dist>(Q, X, num_threads);
+    ASSERT_EQ(D.shape(), Shape(Q.num_rows(), X.num_rows()));
+    Dist dist;
+    for (size_t i = 0; i < Q.num_rows(); i++)
+        for (size_t j = 0; j < X.num_rows(); j++)
+            EXPECT_NEAR(D(i, j), dist(X[j], Q[i]), T{ 1e-3 });
+}
+
+TEST(PairwiseDistancesTests, PairwiseDistancesTest)
+{
+    auto Q = make_random_matrix<float>(150, 20, 3);
+    auto X = make_random_matrix<float>(90, 20, 4);
+    for (size_t num_threads : { 1, 3 })
+    {
+        check_pairwise_distances<L2Distance>(Q, X, num_threads);
+        check_pairwise_distances<L2SquaredDistance>(Q, X, num_threads);
+        check_pairwise_distances<InnerProductDistance>(Q, X, num_threads);
+    }
+
+    l2_normalize_inplace(Q);
+    l2_normalize_inplace(X);
+    check_pairwise_distances<CosineDistance>(Q, X, 2);
+
+    // distance of a point to itself is exactly 0, not a small negative number
+    auto D = pairwise_distances<L2Distance>(X, X);
+    for (size_t i = 0; i < X.num_rows(); i++)
+        EXPECT_NEAR(D(i, i), 0.0f, 1e-3f);
+
+    auto empty = pairwise_distances<L2Distance>(Matrix<float>(0, 20), X);
+    EXPECT_EQ(empty.num_rows(), 0);
+}
+
+TEST(PairwiseDistancesTests, ModifiedDataTest)
+{
+    // norms are computed on every call, so writes through a view taken before are seen
+    Matrix<double> X = { {3.0, 4.0}, {1.0, 0.0} };
+    Matrix<double> Q = { {0.0, 0.0} };
+    auto row = X[1];
+    EXPECT_EQ(pairwise_distances<L2SquaredDistance>(Q, X)(0, 1), 1.0);
+    row[1] = 2.0;
+    EXPECT_EQ(pairwise_distances<L2SquaredDistance>(Q, X)(0, 1), 5.0);
+    EXPECT_EQ(pairwise_distances<L2SquaredDistance>(Q, X)(0, 0), 25.0);
+}
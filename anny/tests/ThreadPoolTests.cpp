@@ -0,0 +1,52 @@
+#include <atomic>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+#include "utils/thread_pool.h"
+
+using namespace anny::utils;
+
+
+TEST(ThreadPoolTests, SubmitTest)
+{
+    ThreadPool pool(3);
+    EXPECT_EQ(pool.num_threads(), 3);
+
+    std::atomic<int> counter{ 0 };
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < 100; i++)
+        futures.push_back(pool.submit([&counter] { counter++; }));
+    for (auto& f : futures)
+        f.get();
+    EXPECT_EQ(counter, 100);
+
+    auto failed = pool.submit([] { throw std::runtime_error("task failed"); });
+    EXPECT_THROW(failed.get(), std::runtime_error);
+}
+
+TEST(ThreadPoolTests, ParallelForTest)
+{
+    ThreadPool pool(4);
+    for (size_t n : { 0, 1, 3, 4, 5, 1000 })
+    {
+        std::vector<int> visits(n, 0);
+        pool.parallel_for(0, n, [&visits](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++)
+                visits[i]++;
+        });
+        EXPECT_EQ(std::accumulate(visits.begin(), visits.end(), 0), static_cast<int>(n));
+        EXPECT_TRUE(std::all_of(visits.begin(), visits.end(), [](int v) { return v == 1; }));
+    }
+
+    // chunks are never smaller than min_chunk
+    std::atomic<size_t> min_seen{ 1000 };
+    pool.parallel_for(10, 110, [&min_seen](size_t first, size_t last) {
+        size_t size = last - first;
+        size_t prev = min_seen.load();
+        while (size < prev && !min_seen.compare_exchange_weak(prev, size)) {}
+    }, /*min_chunk*/ 40);
+    EXPECT_GE(min_seen, 40);
+
+    EXPECT_THROW(pool.parallel_for(0, 100, [](size_t, size_t) { throw std::runtime_error("chunk failed"); }), std::runtime_error);
+}
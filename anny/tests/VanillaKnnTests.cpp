@@ -1,6 +1,8 @@
 #include <iostream>
 #include <gtest/gtest.h>
 #include "algs/vanilla_knn.h"
+#include "core/matrix_mmap.h"
+#include <filesystem>
 
 using namespace anny;
 
@@ -85,3 +87,62 @@ TEST(VanillaKnnTests, VanillaKnnRadiusTest1)
 }
 
 
+
+TEST(VanillaKnnTests, VanillaKnnZeroCopyFitTest)
+{
+	std::vector<std::vector<double>> data = {
+		{1.0, 0.0},
+		{0.0, 1.0},
+		{-1.0, 0.0},
+		{0.0, -1.0},
+		{2.0, 2.0}
+	};
+	std::vector<double> flat;
+	for (const auto& row : data)
+		flat.insert(flat.end(), row.begin(), row.end());
+	std::vector<double> query = { 5.0, 0.5 };
+
+	VanillaKnn<double, anny::L2Distance> expected_alg;
+	expected_alg.fit(data);
+	auto expected = expected_alg.knn_query(query, 4);
+
+	// adopts the vector of a contiguous matrix
+	{
+		Matrix<double> m(MatrixStorageContiguous<double>(std::vector<double>(flat), 2));
+		VanillaKnn<double, anny::L2Distance> alg;
+		alg.fit(std::move(m));
+		EXPECT_EQ(alg.knn_query(query, 4), expected);
+	}
+
+	// adopts aligned storage
+	{
+		Matrix<double, MatrixStorageAligned<double>> m{ MatrixStorageAligned<double>(data) };
+		VanillaKnn<double, anny::L2Distance> alg;
+		alg.fit(std::move(m));
+		EXPECT_EQ(alg.knn_query(query, 4), expected);
+	}
+
+	// adopts memory-mapped file
+	{
+		const std::string path = (std::filesystem::temp_directory_path() / "anny_vanilla_knn_fit.bin").string();
+		MatrixStorageMmap<double>::write(path, Matrix<double>(MatrixStorageContiguous<double>(flat, 2)));
+		Matrix<double, MatrixStorageMmap<double>> m{ MatrixStorageMmap<double>(path) };
+		VanillaKnn<double, anny::L2Distance> alg;
+		alg.fit(std::move(m));
+		EXPECT_EQ(alg.knn_query(query, 4), expected);
+		std::filesystem::remove(path);
+	}
+
+	// references caller memory: packed rows, then rows with padding
+	{
+		VanillaKnn<double, anny::L2Distance> alg;
+		alg.fit(flat.data(), data.size(), 2);
+		EXPECT_EQ(alg.knn_query(query, 4), expected);
+
+		std::vector<double> padded(data.size() * 8, 0.0);
+		for (size_t i = 0; i < data.size(); i++)
+			std::copy(data[i].begin(), data[i].end(), padded.begin() + i * 8);
+		alg.fit(padded.data(), data.size(), 2, 8);
+		EXPECT_EQ(alg.knn_query(query, 4), expected);
+	}
+}
@@ -0,0 +1,58 @@
+#include <vector>
+#include <gtest/gtest.h>
+#include "utils/visited_list_pool.h"
+
+using namespace anny::utils;
+
+
+TEST(VisitedListPoolTests, VisitedListTest)
+{
+    VisitedList visited(10);
+    EXPECT_EQ(visited.size(), 10);
+    EXPECT_FALSE(visited.is_visited(3));
+    EXPECT_TRUE(visited.visit(3));
+    EXPECT_FALSE(visited.visit(3));
+    EXPECT_TRUE(visited.is_visited(3));
+
+    visited.reset();
+    EXPECT_FALSE(visited.is_visited(3));
+    EXPECT_TRUE(visited.visit(3));
+
+    visited.resize(20);
+    EXPECT_TRUE(visited.is_visited(3));
+    EXPECT_FALSE(visited.is_visited(15));
+
+    // epoch wraps around many times, marks of old epochs never look visited
+    for (size_t i = 0; i < 200000; i++)
+    {
+        visited.reset();
+        ASSERT_FALSE(visited.is_visited(i % 20));
+        visited.visit(i % 20);
+        ASSERT_TRUE(visited.is_visited(i % 20));
+    }
+}
+
+TEST(VisitedListPoolTests, PoolTest)
+{
+    VisitedListPool pool(5);
+    EXPECT_EQ(pool.num_free(), 0);
+    {
+        auto first = pool.get();
+        auto second = pool.get();
+        EXPECT_NE(&*first, &*second);
+        EXPECT_EQ(first->size(), 5);
+        first->visit(1);
+    }
+    EXPECT_EQ(pool.num_free(), 2);
+
+    // lists are reused, reset and grown on checkout
+    pool.set_num_elements(8);
+    {
+        auto list = pool.get();
+        EXPECT_EQ(pool.num_free(), 1);
+        EXPECT_EQ(list->size(), 8);
+        for (size_t i = 0; i < list->size(); i++)
+            EXPECT_FALSE(list->is_visited(i));
+    }
+    EXPECT_EQ(pool.num_free(), 2);
+}